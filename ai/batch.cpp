@@ -0,0 +1,302 @@
+#include "batch.hpp"
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../config.hpp"
+
+namespace gomokuai
+{
+    const char positions_magic[8] = {'G', 'M', 'K', 'P', 'O', 'S', '0', '1'};
+    const std::size_t positions_header = sizeof(positions_magic) + sizeof(uint32_t);
+    const std::size_t cell_count = config::board_size * config::board_size;
+
+    // 每块约 64 KiB, 即数百个局面; 块数远多于线程数, 各线程取完一块再取下一块, 负载自然均衡
+    const std::size_t shard_bytes = 64 << 10;
+    const auto progress_interval = std::chrono::seconds(5);
+
+    struct Shard
+    {
+        const char* begin;
+        const char* end;
+        // 块中第一个局面的序号
+        long long first_index;
+    };
+
+    bool parse_text(const char* p, const char* end, Board& board, PIECE_TYPE& side)
+    {
+        std::size_t cells = 0;
+        int black = 0, white = 0;
+        for (; p < end && cells < cell_count; p++)
+        {
+            switch (*p)
+            {
+            case '.': board[cells++] = EMPTY; break;
+            case 'X': board[cells++] = BLACK; black++; break;
+            case 'O': board[cells++] = WHITE; white++; break;
+            case '/': break;
+            default: return false;
+            }
+        }
+        if (cells < cell_count)
+        {
+            return false;
+        }
+        while (p < end && isspace((unsigned char)*p))
+        {
+            p++;
+        }
+        if (p == end)
+        {
+            // 黑方先行
+            side = black > white ? WHITE : BLACK;
+            return true;
+        }
+        if (*p != 'X' && *p != 'O')
+        {
+            return false;
+        }
+        side = *p++ == 'X' ? BLACK : WHITE;
+        return std::all_of(p, end, [](char c){ return isspace((unsigned char)c); });
+    }
+
+    bool parse_binary(const char* p, Board& board, PIECE_TYPE& side)
+    {
+        for (std::size_t i = 0; i < cell_count; i++)
+        {
+            if ((uint8_t)p[i] > WHITE)
+            {
+                return false;
+            }
+            board[i] = (PIECE_TYPE)p[i];
+        }
+        side = (PIECE_TYPE)p[cell_count];
+        return side == BLACK || side == WHITE;
+    }
+
+    // 文本按行切块, 序号为行号; 二进制按局面数切块
+    bool make_shards(const char* data, std::size_t size, bool& binary, std::vector<Shard>& shards)
+    {
+        const char* end = data + size;
+        binary = size >= sizeof(positions_magic) && memcmp(data, positions_magic, sizeof(positions_magic)) == 0;
+        if (binary)
+        {
+            uint32_t board_size = 0;
+            if (size >= positions_header)
+            {
+                memcpy(&board_size, data + sizeof(positions_magic), sizeof(board_size));
+            }
+            if (board_size != config::board_size)
+            {
+                logger.error("Positions are not on a {}x{} board.", config::board_size, config::board_size);
+                return false;
+            }
+            std::size_t record = cell_count + 1;
+            std::size_t count = (size - positions_header) / record;
+            if (positions_header + count * record != size)
+            {
+                logger.warn("Ignoring a truncated position at the end of the file.");
+            }
+            std::size_t per_shard = std::max<std::size_t>(1, shard_bytes / record);
+            for (std::size_t first = 0; first < count; first += per_shard)
+            {
+                const char* begin = data + positions_header + first * record;
+                shards.push_back({begin, begin + std::min(per_shard, count - first) * record, (long long)first});
+            }
+            return true;
+        }
+        long long line = 1;
+        for (const char* p = data; p < end;)
+        {
+            const char* target = p + std::min<std::size_t>(shard_bytes, end - p);
+            auto newline = (const char*)memchr(target, '\n', end - target);
+            const char* shard_end = newline ? newline + 1 : end;
+            shards.push_back({p, shard_end, line});
+            line += std::count(p, shard_end, '\n');
+            p = shard_end;
+        }
+        return true;
+    }
+
+    long long analyse_file(const string& input, const string& output, int threads)
+    {
+        int fd = open(input.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0)
+        {
+            logger.error("Cannot open positions file {}.", input);
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            return -1;
+        }
+        std::size_t size = info.st_size;
+        const char* data = nullptr;
+        if (size > 0)
+        {
+            void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED)
+            {
+                logger.error("Cannot map positions file {}.", input);
+                close(fd);
+                return -1;
+            }
+            data = (const char*)mapped;
+            madvise(mapped, size, MADV_SEQUENTIAL);
+        }
+        close(fd);
+
+        std::ofstream file(output);
+        std::vector<Shard> shards;
+        bool binary;
+        if (!file || !make_shards(data, size, binary, shards))
+        {
+            if (!file)
+            {
+                logger.error("Cannot write analysis to {}.", output);
+            }
+            if (data)
+            {
+                munmap((void*)data, size);
+            }
+            return -1;
+        }
+        file << "index,side,row,col,score,microseconds\n";
+
+        if (threads <= 0)
+        {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        logger.info("Analysing {} ({} format, {} shards) with {} threads.", input, binary ? "binary" : "text", shards.size(), threads);
+
+        std::atomic<std::size_t> next_shard = 0;
+        std::atomic<long long> analysed = 0, invalid = 0;
+        std::mutex output_lock;
+        std::mutex done_lock;
+        std::condition_variable done_cond;
+        int running = threads;
+        long page_size = sysconf(_SC_PAGESIZE);
+
+        // 每个线程有自己的棋盘和输出缓冲区, 搜索之间不共享任何状态
+        auto work = [&]
+        {
+            Board board;
+            PIECE_TYPE side;
+            string out;
+            std::size_t index;
+            while ((index = next_shard++) < shards.size())
+            {
+                auto& shard = shards[index];
+                long long position = shard.first_index;
+                long long count = 0;
+                auto analyse_one = [&]
+                {
+                    auto begin = std::chrono::steady_clock::now();
+                    auto result = analyse(board, side);
+                    auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+                    out.append(format(
+                        "{},{},{},{},{},{}\n", position, side == BLACK ? 'X' : 'O', result.point.row, result.point.col, result.score, us
+                    ));
+                    count++;
+                };
+                if (binary)
+                {
+                    for (const char* p = shard.begin; p < shard.end; p += cell_count + 1, position++)
+                    {
+                        if (!parse_binary(p, board, side))
+                        {
+                            invalid++;
+                            continue;
+                        }
+                        analyse_one();
+                    }
+                }
+                else
+                {
+                    for (const char* p = shard.begin; p < shard.end; position++)
+                    {
+                        auto newline = (const char*)memchr(p, '\n', shard.end - p);
+                        const char* line_end = newline ? newline : shard.end;
+                        bool blank = std::all_of(p, line_end, [](char c){ return isspace((unsigned char)c); });
+                        if (!blank && *p != '#')
+                        {
+                            if (parse_text(p, line_end, board, side))
+                            {
+                                analyse_one();
+                            }
+                            else
+                            {
+                                invalid++;
+                            }
+                        }
+                        p = newline ? newline + 1 : shard.end;
+                    }
+                }
+                {
+                    auto guard = std::lock_guard(output_lock);
+                    file.write(out.data(), out.size());
+                }
+                out.clear();
+                analysed += count;
+                // 已分析的页不再需要, 文件再大驻留内存也有限
+                auto page_begin = (uintptr_t)shard.begin / page_size * page_size;
+                auto page_end = (uintptr_t)shard.end / page_size * page_size;
+                if (page_end > page_begin)
+                {
+                    madvise((void*)page_begin, page_end - page_begin, MADV_DONTNEED);
+                }
+            }
+            auto guard = std::lock_guard(done_lock);
+            if (--running == 0)
+            {
+                done_cond.notify_all();
+            }
+        };
+
+        auto begin = std::chrono::steady_clock::now();
+        auto seconds = [&]{ return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count(); };
+        std::vector<std::thread> workers;
+        for (int i = 0; i < threads; i++)
+        {
+            workers.emplace_back(work);
+        }
+        {
+            auto guard = std::unique_lock(done_lock);
+            while (!done_cond.wait_for(guard, progress_interval, [&]{ return running == 0; }))
+            {
+                logger.info("{} positions analysed, {:.0f} positions/s.", analysed.load(), analysed / seconds());
+            }
+        }
+        for (auto& worker: workers)
+        {
+            worker.join();
+        }
+        double elapsed = seconds();
+        file.close();
+        if (data)
+        {
+            munmap((void*)data, size);
+        }
+
+        logger.info(
+            "Analysed {} positions in {:.2f} s, {:.0f} positions/s with {} threads, results written to {}.",
+            analysed.load(), elapsed, analysed / elapsed, threads, output
+        );
+        if (invalid > 0)
+        {
+            logger.warn("{} malformed positions were skipped.", invalid.load());
+        }
+        return analysed;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "gomokuai.hpp"
+
+namespace gomokuai
+{
+    // 离线批量分析局面文件, 文件以内存映射读取, 分块交给各线程, 内存占用与文件大小无关
+    // 文本格式: 每行一个局面, board_size * board_size 个字符按行优先给出各格, '.' 为空, 'X' 为黑, 'O' 为白,
+    // 可用 '/' 分隔各行; 之后可跟空白和轮到的一方 'X' 或 'O', 省略时由棋子数推断; '#' 开头的行为注释
+    // 二进制格式: 8 字节 "GMKPOS01", 4 字节棋盘边长, 之后每个局面 board_size * board_size 字节 (0 空, 1 黑, 2 白) 加 1 字节轮到的一方
+    // 输出为 CSV: 局面序号 (文本为行号), 轮到的一方, 最佳落子点, 评分, 用时 (微秒); 按完成的先后逐块写出
+    // threads 为 0 时使用全部核心, 返回分析的局面数, 无法读写文件时返回 -1
+    long long analyse_file(const string& input, const string& output, int threads);
+}
\ No newline at end of file
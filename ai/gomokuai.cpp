@@ -9,9 +9,12 @@
 #include "gomokuai.hpp"
 
 #include <vector>
-#include <cstring>
+#include <fstream>
+#include <algorithm>
 
 #include "../config.hpp"
+#include "../tracing.hpp"
+#include "../metrics.hpp"
 
 using std::vector;
 using config::board_size;
@@ -22,65 +25,120 @@ namespace gomokuai
 
     #define INFINITY 1000000000
 
-    PIECE_TYPE* chessData;
-
-    PIECE_TYPE ai_piece_type;
-    float attack_coef;
+    // init(), put_chess() 等操作的默认棋盘; 搜索只读取传入的棋盘, 可在多个线程中同时进行
+    Board chess_board{};
 
     // 棋型
     struct ChessModel;
 
     vector<ChessModel*> chess_models;
 
+    // 分值见 EngineParams::model_scores, 下标为 index
     struct ChessModel
     {
         vector<string> values;
-        int score;
+        int index;
 
-        ChessModel(int set_score, vector<string>&& set_values):
-            score(set_score),
-            values(set_values)
+        ChessModel(vector<string>&& set_values):
+            values(set_values),
+            index(chess_models.size())
         {
             chess_models.push_back(this);
         }
     }
         // 连五
-        LIANWU(10000000, {"11111"}),
+        LIANWU({"11111"}),
         // 活四
-        HUOSI(1000000, {"011110"}),
+        HUOSI({"011110"}),
         // 活三
-        HUOSAN(10000, {"001110", "011100", "010110", "011010"}),
+        HUOSAN({"001110", "011100", "010110", "011010"}),
         // 冲四
-        CHONGSI(9000, {"11110", "01111", "10111", "11011", "11101"}),
+        CHONGSI({"11110", "01111", "10111", "11011", "11101"}),
         // 活二
-        HUOER(100, {"001100", "011000", "000110", "001010", "010100"}),
+        HUOER({"001100", "011000", "000110", "001010", "010100"}),
         // 活一
-        HUOYI(80, {"010200", "002010", "020100", "001020", "201000", "000102", "000201"}),
+        HUOYI({"010200", "002010", "020100", "001020", "201000", "000102", "000201"}),
         // 眠三
-        MIANSAN(30, {"001112", "010112", "011012", "211100", "211010"}),
+        MIANSAN({"001112", "010112", "011012", "211100", "211010"}),
         // 眠二
-        MIANER(10, {"011200", "001120", "002110", "021100", "110000", "000011", "000112", "211000"}),
+        MIANER({"011200", "001120", "002110", "021100", "110000", "000011", "000112", "211000"}),
         // 眠一
-        MIANYI(1, {"001200", "002100", "000210", "000120", "210000", "000012"});
+        MIANYI({"001200", "002100", "000210", "000120", "210000", "000012"});
+
+    // 对局使用的参数, 只在 AI 线程池启动前修改
+    EngineParams engine_params;
 
-    enum RiskScore
+    void set_params(const EngineParams& params)
     {
-        HIGH_RISK = 800000,
-        MEDIUM_RISK = 500000,
-        LOW_RISK = 100000,
-    };
+        engine_params = params;
+    }
+
+    const EngineParams& get_params()
+    {
+        return engine_params;
+    }
+
+    bool load_params(const string& path, EngineParams& params)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            return false;
+        }
+        EngineParams loaded;
+        string key;
+        while (file >> key)
+        {
+            auto name = std::find(std::begin(model_names), std::end(model_names), key);
+            if (name != std::end(model_names)) file >> loaded.model_scores[name - std::begin(model_names)];
+            else if (key == "high_risk") file >> loaded.high_risk;
+            else if (key == "medium_risk") file >> loaded.medium_risk;
+            else if (key == "low_risk") file >> loaded.low_risk;
+            else if (key == "black_attack") file >> loaded.black_attack;
+            else if (key == "white_attack") file >> loaded.white_attack;
+            else
+            {
+                logger.warn("Unknown key {} in engine parameters {}.", key, path);
+                std::getline(file, key);
+            }
+            if (!file)
+            {
+                logger.error("Malformed engine parameters {}.", path);
+                return false;
+            }
+        }
+        params = loaded;
+        return true;
+    }
+
+    bool save_params(const string& path, const EngineParams& params)
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            logger.error("Cannot write engine parameters {}.", path);
+            return false;
+        }
+        for (std::size_t i = 0; i < params.model_scores.size(); i++)
+        {
+            file << format("{} {}\n", model_names[i], params.model_scores[i]);
+        }
+        file << format("high_risk {}\nmedium_risk {}\nlow_risk {}\n", params.high_risk, params.medium_risk, params.low_risk);
+        file << format("black_attack {}\nwhite_attack {}\n", params.black_attack, params.white_attack);
+        return (bool)file;
+    }
 
     void init()
     {
-        chessData = new PIECE_TYPE[board_size * board_size]();
+        clear();
     }
 
     void clear()
     {
-        memset(chessData, EMPTY, board_size * board_size * sizeof(PIECE_TYPE));
+        chess_board.fill(EMPTY);
     }
 
-    PIECE_TYPE get_point(Coord_2D point)
+    PIECE_TYPE get_point(const Board& board, Coord_2D point)
     {
         if (
             point.row < 0 ||
@@ -91,10 +149,15 @@ namespace gomokuai
         {
             return ERROR;
         }
-        return chessData[point.row * board_size + point.col];
+        return board[point.row * board_size + point.col];
     }
 
-    void put_chess(Coord_2D point, PIECE_TYPE type)
+    PIECE_TYPE get_point(Coord_2D point)
+    {
+        return get_point(chess_board, point);
+    }
+
+    void put_chess(Board& board, Coord_2D point, PIECE_TYPE type)
     {
         if (
             point.row < 0 ||
@@ -105,10 +168,20 @@ namespace gomokuai
         {
             return;
         }
-        chessData[point.row * board_size + point.col] = type;
+        board[point.row * board_size + point.col] = type;
+    }
+
+    void put_chess(Coord_2D point, PIECE_TYPE type)
+    {
+        put_chess(chess_board, point, type);
+    }
+
+    void set_board(const Board& board)
+    {
+        chess_board = board;
     }
 
-    vector<string> get_situation(Coord_2D point)
+    vector<string> get_situation(const Board& board, Coord_2D point)
     {
         const static vector<Coord_2D> directions{
             {1, 0},
@@ -117,7 +190,7 @@ namespace gomokuai
             {-1, 1}
         };
         vector<string> situations;
-        PIECE_TYPE type = get_point(point);
+        PIECE_TYPE type = get_point(board, point);
         if (type == EMPTY)
         {
             return situations;
@@ -127,7 +200,7 @@ namespace gomokuai
             string pieces;
             for (int i = -4; i <= 4; i++)
             {
-                PIECE_TYPE piece_type = get_point(point + direction * i);
+                PIECE_TYPE piece_type = get_point(board, point + direction * i);
                 if (piece_type == EMPTY)
                 {
                     pieces.append("0");
@@ -173,7 +246,7 @@ namespace gomokuai
         return false;
     }
 
-    int evaluate(Coord_2D point)
+    int evaluate(const Board& board, Coord_2D point, const EngineParams& params)
     {
         // 分值
         int score = 0;
@@ -184,7 +257,7 @@ namespace gomokuai
         // 同一方向既活三又冲四数
         int tf_count = 0;
 
-        auto situations = get_situation(point);
+        auto situations = get_situation(board, point);
         for (auto& situation: situations)
         {
             auto chess_model = get_chess_model(situation);
@@ -202,76 +275,104 @@ namespace gomokuai
                 {
                     chongsi_count++;
                 }
-                score += chess_model->score;
+                score += params.model_scores[chess_model->index];
             }
         }
 
         if (chongsi_count > 1 || tf_count > 1)
         {
-            score += HIGH_RISK;
+            score += params.high_risk;
         }
         else if (chongsi_count > 0 && huosan_count > 0 || tf_count > 0 && huosan_count > 1)
         {
-            score += MEDIUM_RISK;
+            score += params.medium_risk;
         }
         else if (huosan_count > 1)
         {
-            score += LOW_RISK;
+            score += params.low_risk;
         }
 
         return score;
     }
 
-    Coord_2D get_best_point()
+    metrics::Counter& nodes_total = metrics::counter("gomoku_ai_nodes_total", "Board positions evaluated by the AI");
+    metrics::Histogram& nodes_searched = metrics::histogram(
+        "gomoku_ai_nodes_searched", "Board positions evaluated for one move", metrics::exponential_buckets(8, 2, 8)
+    );
+    metrics::Histogram& think_time = metrics::histogram(
+        "gomoku_ai_think_seconds", "Time the AI spends choosing a move", metrics::exponential_buckets(0.0001, 2, 16)
+    );
+
+    // board 在搜索中被临时修改, 返回前复原
+    Analysis get_best_point(Board& board, PIECE_TYPE ai_piece_type, float attack_coef, const EngineParams& params)
     {
-        Coord_2D best;
-        int score = -INFINITY;
+        Analysis best;
+        best.score = -INFINITY;
 
         for (int i = 0; i < board_size; i++)
         {
             for (int j = 0; j < board_size; j++)
             {
                 Coord_2D point(i, j);
-                if (get_point(point) != EMPTY)
+                if (get_point(board, point) != EMPTY)
                 {
                     continue;
                 }
 
-                put_chess(point, ai_piece_type);
-                int ai_score = evaluate(point);
-                put_chess(point, (PIECE_TYPE)(3 - ai_piece_type));
-                int foe_score = evaluate(point);
-                put_chess(point, EMPTY);
+                put_chess(board, point, ai_piece_type);
+                int ai_score = evaluate(board, point, params);
+                put_chess(board, point, (PIECE_TYPE)(3 - ai_piece_type));
+                int foe_score = evaluate(board, point, params);
+                put_chess(board, point, EMPTY);
+                best.nodes += 2;
                 int val = ai_score * attack_coef + foe_score;
-                if (val > score)
+                if (val > best.score)
                 {
-                    score = val;
-                    best = point;
+                    best.score = val;
+                    best.point = point;
                 }
             }
         }
-
         return best;
     }
 
-    Coord_2D get_next_point(PIECE_TYPE ai_piece_type)
+    Analysis analyse(Board& board, PIECE_TYPE ai_piece_type, const EngineParams& params)
     {
         int piece_count = 0;
         int grid_count = board_size * board_size;
         for (int i = 0; i < grid_count; i++)
         {
-            if (chessData[i] != EMPTY)
+            if (board[i] != EMPTY)
             {
                 piece_count++;
             }
         }
-        gomokuai::ai_piece_type = ai_piece_type;
-        attack_coef = ai_piece_type == BLACK ? 1.8 : 0.5;
+        float attack_coef = ai_piece_type == BLACK ? params.black_attack : params.white_attack;
 
         if (piece_count == 0)
         {
-            return Coord_2D(board_size / 2, board_size / 2);
+            return {Coord_2D(board_size / 2, board_size / 2), 0, 0};
+        }
+        return get_best_point(board, ai_piece_type, attack_coef, params);
+    }
+
+    Coord_2D get_next_point(const Board& board, PIECE_TYPE ai_piece_type, const EngineParams& params)
+    {
+        tracing::Span span("AI think", "ai");
+        auto think_begin = std::chrono::steady_clock::now();
+        Board search_board = board;
+        auto best = analyse(search_board, ai_piece_type, params);
+        if (best.nodes > 0)
+        {
+            nodes_total.add(best.nodes);
+            nodes_searched.observe(best.nodes);
+            think_time.observe(std::chrono::steady_clock::now() - think_begin);
         }
-        return get_best_point();
+        return best.point;
+    }
+
+    Coord_2D get_next_point(PIECE_TYPE ai_piece_type)
+    {
+        return get_next_point(chess_board, ai_piece_type);
     }
 }
\ No newline at end of file
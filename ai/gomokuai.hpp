@@ -8,6 +8,8 @@
 
 #pragma once
 
+#include <array>
+
 #include "../logger.hpp"
 
 namespace gomokuai
@@ -49,7 +51,37 @@ namespace gomokuai
             return Coord_2D(row * num, col * num);
         }
     };
-    
+
+    // 棋盘状态, 按行优先存储
+    using Board = std::array<PIECE_TYPE, config::board_size * config::board_size>;
+
+    // 参数文件中各棋型的名称, 顺序与 EngineParams::model_scores 相同
+    inline const char* const model_names[] = {
+        "lianwu", "huosi", "huosan", "chongsi", "huoer", "huoyi", "miansan", "mianer", "mianyi",
+    };
+
+    // 估值参数: 各棋型的分值, 组合棋型的加分, 以及执黑和执白时进攻相对防守的权重
+    struct EngineParams
+    {
+        std::array<int, std::size(model_names)> model_scores{10000000, 1000000, 10000, 9000, 100, 80, 30, 10, 1};
+        int high_risk = 800000;
+        int medium_risk = 500000;
+        int low_risk = 100000;
+        float black_attack = 1.8f;
+        float white_attack = 0.5f;
+
+        bool operator==(const EngineParams&) const = default;
+    };
+
+    // 参数文件每行为 名称 值, 文件中没有的参数使用默认值; 失败时返回 false, params 不变
+    bool load_params(const string& path, EngineParams& params);
+
+    bool save_params(const string& path, const EngineParams& params);
+
+    // get_next_point() 默认使用的参数, 只在 AI 线程池启动前设置
+    void set_params(const EngineParams& params);
+
+    const EngineParams& get_params();
 
     // 初始化棋盘
     void init();
@@ -63,6 +95,24 @@ namespace gomokuai
     // 放置棋子
     void put_chess(Coord_2D point, PIECE_TYPE type);
 
-    // 获取AI的下一步下棋点位
+    // 用给定棋盘状态替换当前棋盘
+    void set_board(const Board& board);
+
+    // 获取AI在当前棋盘上的下一步下棋点位
     Coord_2D get_next_point(PIECE_TYPE ai_piece_type);
+
+    // 获取AI在 board 上的下一步下棋点位, 不读写当前棋盘, 可在多个线程中同时调用
+    Coord_2D get_next_point(const Board& board, PIECE_TYPE ai_piece_type, const EngineParams& params = get_params());
+
+    struct Analysis
+    {
+        Coord_2D point;
+        // 落子点的评分, 以及评估过的局面数
+        int score = 0;
+        int nodes = 0;
+    };
+
+    // 与 get_next_point() 相同的搜索, 另外给出评分; 不记录指标和时间线, 供批量分析和调参在各线程中调用
+    // board 在搜索中被临时修改, 返回前复原
+    Analysis analyse(Board& board, PIECE_TYPE ai_piece_type, const EngineParams& params = get_params());
 }
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "pool.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <vector>
+
+#include "../metrics.hpp"
+#include "../tracing.hpp"
+
+namespace gomokuai
+{
+    struct ThinkRequest
+    {
+        Board board;
+        PIECE_TYPE ai_piece_type;
+        std::chrono::steady_clock::time_point on_clock_since;
+        std::chrono::steady_clock::time_point submitted;
+        EngineParams params;
+        std::promise<Coord_2D> result;
+
+        // priority_queue 取最大者, 等待越久越大
+        bool operator<(const ThinkRequest& other) const
+        {
+            return on_clock_since > other.on_clock_since;
+        }
+    };
+
+    std::mutex pool_lock;
+    std::condition_variable pool_cond;
+    std::priority_queue<ThinkRequest> requests;
+    std::vector<std::thread> workers;
+    bool pool_stopping = false;
+
+    metrics::Histogram& queue_time = metrics::histogram(
+        "gomoku_ai_queue_seconds", "Time a move request waits for a free AI thread", metrics::exponential_buckets(0.0001, 2, 16)
+    );
+
+    void worker_run(int index)
+    {
+        tracing::set_thread_name(format("AI worker {}", index).c_str());
+        while (true)
+        {
+            auto lock = std::unique_lock(pool_lock);
+            pool_cond.wait(lock, []{ return pool_stopping || !requests.empty(); });
+            if (requests.empty())
+            {
+                return;
+            }
+            // priority_queue 只提供 const 引用, 元素出队前不会再被比较
+            ThinkRequest request = std::move(const_cast<ThinkRequest&>(requests.top()));
+            requests.pop();
+            lock.unlock();
+            queue_time.observe(std::chrono::steady_clock::now() - request.submitted);
+            request.result.set_value(get_next_point(request.board, request.ai_piece_type, request.params));
+        }
+    }
+
+    void pool_start(int threads)
+    {
+        pool_stop();
+        pool_stopping = false;
+        for (int i = 0; i < threads; i++)
+        {
+            workers.emplace_back(worker_run, i);
+        }
+        logger.info("AI pool started with {} threads.", threads);
+    }
+
+    void pool_stop()
+    {
+        {
+            auto guard = std::lock_guard(pool_lock);
+            pool_stopping = true;
+        }
+        pool_cond.notify_all();
+        // 已提交的请求先处理完, 等待者不会永远阻塞
+        for (auto& worker: workers)
+        {
+            worker.join();
+        }
+        workers.clear();
+    }
+
+    std::future<Coord_2D> think_async(
+        const Board& board, PIECE_TYPE ai_piece_type, std::chrono::steady_clock::time_point on_clock_since,
+        const EngineParams& params
+    )
+    {
+        ThinkRequest request{board, ai_piece_type, on_clock_since, std::chrono::steady_clock::now(), params, {}};
+        auto future = request.result.get_future();
+        auto lock = std::unique_lock(pool_lock);
+        if (workers.empty() || pool_stopping)
+        {
+            lock.unlock();
+            request.result.set_value(get_next_point(board, ai_piece_type, params));
+            return future;
+        }
+        requests.push(std::move(request));
+        lock.unlock();
+        pool_cond.notify_one();
+        return future;
+    }
+}
\ No newline at end of file
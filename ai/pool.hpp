@@ -0,0 +1,21 @@
+#pragma once
+
+#include <chrono>
+#include <future>
+
+#include "gomokuai.hpp"
+
+namespace gomokuai
+{
+    // 多个工位共用的 AI 线程池, 按工位开始等待的先后处理请求, 最先轮到走棋的工位最先得到结果
+    void pool_start(int threads);
+
+    void pool_stop();
+
+    // on_clock_since 为该工位这一步开始计时 (对手按键) 的时间, 越早越优先
+    // 线程池未启动时在调用线程中直接计算
+    std::future<Coord_2D> think_async(
+        const Board& board, PIECE_TYPE ai_piece_type, std::chrono::steady_clock::time_point on_clock_since,
+        const EngineParams& params = get_params()
+    );
+}
\ No newline at end of file
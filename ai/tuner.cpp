@@ -0,0 +1,368 @@
+#include "tuner.hpp"
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <functional>
+
+#include "../config.hpp"
+
+using config::board_size;
+
+namespace gomokuai
+{
+    // SPSA 增益: 第 k 轮的扰动幅度 c / (k + 1)^0.101, 步长 a / (k + 1 + A)^0.602
+    const double spsa_a = 0.2;
+    const double spsa_c = 0.1;
+    const double spsa_A = 50;
+    // 每轮对弈的开局数, 每个开局双方各执黑一次; 开局在中央 5x5 内随机放的棋子数
+    const int openings_per_iteration = 64;
+    const int opening_stones = 3;
+    // 每隔多少轮与起始参数对弈一次, 检查是否真的变强
+    const int check_interval = 50;
+    const int check_openings = 128;
+    const auto report_interval = std::chrono::seconds(30);
+
+    // 参数在对数空间中调整, 分值相差几个数量级也能用相同的扰动幅度
+    // 上限保证估值不会溢出 int
+    const double min_score = 1, max_score = 2e7;
+    const double min_attack = 0.1, max_attack = 10;
+
+    // theta 的前 score_count 项为整数分值, 最后两项为进攻系数
+    const std::size_t score_count = std::size(model_names) + 3;
+    const std::size_t theta_size = score_count + 2;
+    using Theta = std::array<double, theta_size>;
+
+    int& score_at(EngineParams& params, std::size_t i)
+    {
+        if (i < params.model_scores.size())
+        {
+            return params.model_scores[i];
+        }
+        int* risks[] = {&params.high_risk, &params.medium_risk, &params.low_risk};
+        return *risks[i - params.model_scores.size()];
+    }
+
+    Theta to_theta(EngineParams params)
+    {
+        Theta theta;
+        for (std::size_t i = 0; i < score_count; i++)
+        {
+            theta[i] = std::log(std::max<double>(score_at(params, i), min_score));
+        }
+        theta[score_count] = std::log(std::max<double>(params.black_attack, min_attack));
+        theta[score_count + 1] = std::log(std::max<double>(params.white_attack, min_attack));
+        return theta;
+    }
+
+    EngineParams from_theta(const Theta& theta)
+    {
+        EngineParams params;
+        for (std::size_t i = 0; i < score_count; i++)
+        {
+            score_at(params, i) = (int)std::lround(std::clamp(std::exp(theta[i]), min_score, max_score));
+        }
+        params.black_attack = std::clamp(std::exp(theta[score_count]), min_attack, max_attack);
+        params.white_attack = std::clamp(std::exp(theta[score_count + 1]), min_attack, max_attack);
+        return params;
+    }
+
+    // 对弈用的参数是整数, 分值较小时正反扰动取整后可能相同 (如 mianyi 为 1 时), 这一项就无法调整
+    // 此时把 delta 为正的一方拉开一个整数单位; 返回两组参数在对数空间中实际相差的量, 梯度按它估计
+    Theta perturb(const Theta& theta, const Theta& delta, double c, EngineParams& plus, EngineParams& minus)
+    {
+        Theta spread;
+        for (std::size_t i = 0; i < theta_size; i++)
+        {
+            spread[i] = 2 * c * delta[i];
+        }
+        Theta plus_theta, minus_theta;
+        for (std::size_t i = 0; i < theta_size; i++)
+        {
+            plus_theta[i] = theta[i] + c * delta[i];
+            minus_theta[i] = theta[i] - c * delta[i];
+        }
+        plus = from_theta(plus_theta);
+        minus = from_theta(minus_theta);
+        for (std::size_t i = 0; i < score_count; i++)
+        {
+            int& higher = score_at(delta[i] > 0 ? plus : minus, i);
+            int& lower = score_at(delta[i] > 0 ? minus : plus, i);
+            if (higher <= lower)
+            {
+                // 已到上限时改为压低另一方
+                if (lower < max_score)
+                {
+                    higher = lower + 1;
+                }
+                else
+                {
+                    higher = lower;
+                    lower--;
+                }
+            }
+            spread[i] = std::log((double)score_at(plus, i) / score_at(minus, i));
+        }
+        return spread;
+    }
+
+    void clamp_theta(Theta& theta)
+    {
+        for (std::size_t i = 0; i < theta_size; i++)
+        {
+            bool attack = i >= theta_size - 2;
+            theta[i] = std::clamp(theta[i], std::log(attack ? min_attack : min_score), std::log(attack ? max_attack : max_score));
+        }
+    }
+
+    bool is_five(const Board& board, Coord_2D point, PIECE_TYPE type)
+    {
+        const int directions[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+        for (auto& d: directions)
+        {
+            int count = 1;
+            for (int sign: {-1, 1})
+            {
+                int row = point.row + sign * d[0], col = point.col + sign * d[1];
+                while (row >= 0 && row < board_size && col >= 0 && col < board_size && board[row * board_size + col] == type)
+                {
+                    count++;
+                    row += sign * d[0];
+                    col += sign * d[1];
+                }
+            }
+            if (count >= 5)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Board random_opening(std::mt19937_64& rng)
+    {
+        Board board;
+        board.fill(EMPTY);
+        std::uniform_int_distribution<int> cell(board_size / 2 - 2, board_size / 2 + 2);
+        for (int placed = 0; placed < opening_stones;)
+        {
+            auto& point = board[cell(rng) * board_size + cell(rng)];
+            if (point == EMPTY)
+            {
+                point = placed++ % 2 ? WHITE : BLACK;
+            }
+        }
+        return board;
+    }
+
+    // 黑胜返回 1, 白胜返回 -1, 下满为和棋返回 0
+    int play_game(Board board, const EngineParams& black, const EngineParams& white)
+    {
+        int stones = std::count_if(board.begin(), board.end(), [](PIECE_TYPE p){ return p != EMPTY; });
+        PIECE_TYPE side = stones % 2 ? WHITE : BLACK;
+        for (; stones < (int)board.size(); stones++)
+        {
+            auto move = analyse(board, side, side == BLACK ? black : white).point;
+            if (move.row < 0)
+            {
+                break;
+            }
+            board[move.row * board_size + move.col] = side;
+            if (is_five(board, move, side))
+            {
+                return side == BLACK ? 1 : -1;
+            }
+            side = (PIECE_TYPE)(3 - side);
+        }
+        return 0;
+    }
+
+    std::atomic<long long> games_played = 0;
+
+    // 各线程轮流取开局, 每个开局 first 和 second 各执黑一次, 返回 first 的净胜局数
+    // 开局由 seed 和开局序号决定, 与线程数无关
+    int play_match(const EngineParams& first, const EngineParams& second, int openings, uint64_t seed, int threads)
+    {
+        std::atomic<int> next_opening = 0, net_wins = 0;
+        std::vector<std::thread> workers;
+        for (int i = 0; i < threads; i++)
+        {
+            workers.emplace_back([&]
+            {
+                int opening;
+                while ((opening = next_opening++) < openings)
+                {
+                    std::mt19937_64 rng(seed * 1000003 + opening);
+                    auto board = random_opening(rng);
+                    net_wins += play_game(board, first, second) - play_game(board, second, first);
+                    games_played += 2;
+                }
+            });
+        }
+        for (auto& worker: workers)
+        {
+            worker.join();
+        }
+        return net_wins;
+    }
+
+    // 继续调整所需的状态: 下一轮的序号, 未取整的当前参数, 以及检查时对比的起始参数
+    struct Progress
+    {
+        int iteration = 0;
+        Theta theta, start;
+    };
+
+    bool load_progress(const string& path, Progress& progress)
+    {
+        std::ifstream file(path);
+        Progress loaded;
+        if (!(file >> loaded.iteration))
+        {
+            return false;
+        }
+        for (auto values: {&loaded.theta, &loaded.start})
+        {
+            for (auto& value: *values)
+            {
+                file >> value;
+            }
+        }
+        if (!file)
+        {
+            logger.error("Malformed tuning progress {}.", path);
+            return false;
+        }
+        progress = loaded;
+        return true;
+    }
+
+    // 先写临时文件再改名, 通宵运行中途被打断也不会留下写了一半的文件
+    void replace_file(const string& path, const std::function<bool(const string&)>& write)
+    {
+        string temp_path = path + ".tmp";
+        std::error_code error;
+        if (write(temp_path))
+        {
+            std::filesystem::rename(temp_path, path, error);
+        }
+        if (error)
+        {
+            logger.error("Cannot replace {}: {}", path, error.message());
+        }
+    }
+
+    // output 为取整后可直接加载的参数, output.progress 为继续调整所需的状态
+    void save_progress(const string& output, const Progress& progress)
+    {
+        replace_file(output, [&](const string& path){ return save_params(path, from_theta(progress.theta)); });
+        replace_file(output + ".progress", [&](const string& path)
+        {
+            std::ofstream file(path);
+            file << progress.iteration << '\n';
+            for (auto values: {&progress.theta, &progress.start})
+            {
+                for (auto value: *values)
+                {
+                    file << format("{} ", value);
+                }
+                file << '\n';
+            }
+            return (bool)file;
+        });
+    }
+
+    void tune(const string& output, int iterations, int threads)
+    {
+        if (threads <= 0)
+        {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        Progress progress;
+        if (load_progress(output + ".progress", progress))
+        {
+            logger.info("Resuming tuning from {} at iteration {}.", output, progress.iteration);
+        }
+        else
+        {
+            EngineParams start;
+            if (load_params(config::engine_params_file, start))
+            {
+                logger.info("Tuning from {}.", config::engine_params_file);
+            }
+            else
+            {
+                logger.info("Tuning from the default parameters.");
+            }
+            progress.theta = progress.start = to_theta(start);
+        }
+        int iteration = progress.iteration;
+        auto& theta = progress.theta;
+        // 检查时始终与最初的起始参数对弈, 中断后继续也不变
+        EngineParams start = from_theta(progress.start);
+        logger.info(
+            "SPSA over {} parameters, {} games per iteration on {} threads, writing to {}.",
+            theta_size, openings_per_iteration * 2, threads, output
+        );
+
+        auto begin = std::chrono::steady_clock::now();
+        auto last_report = begin;
+        long long games_at_report = games_played;
+        double result_sum = 0;
+        int result_count = 0;
+        for (int done = 0; iterations == 0 || done < iterations; done++, iteration++)
+        {
+            double c = spsa_c / std::pow(iteration + 1, 0.101);
+            double a = spsa_a / std::pow(iteration + 1 + spsa_A, 0.602);
+            std::mt19937_64 rng(iteration);
+            Theta delta;
+            for (std::size_t i = 0; i < theta_size; i++)
+            {
+                delta[i] = rng() % 2 ? 1 : -1;
+            }
+            EngineParams plus, minus;
+            Theta spread = perturb(theta, delta, c, plus, minus);
+            // 同一组开局上两组参数各对弈两次, 净胜率即两者强弱之差的估计
+            int net_wins = play_match(plus, minus, openings_per_iteration, iteration, threads);
+            double result = net_wins / (2.0 * openings_per_iteration);
+            for (std::size_t i = 0; i < theta_size; i++)
+            {
+                theta[i] += a * result / spread[i];
+            }
+            clamp_theta(theta);
+            progress.iteration = iteration + 1;
+            save_progress(output, progress);
+            result_sum += result;
+            result_count++;
+
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_report >= report_interval)
+            {
+                double seconds = std::chrono::duration<double>(now - last_report).count();
+                logger.info(
+                    "Iteration {}: {:.1f} games/s, mean perturbation result {:+.3f}.",
+                    iteration + 1, (games_played - games_at_report) / seconds, result_sum / result_count
+                );
+                last_report = now;
+                games_at_report = games_played;
+                result_sum = 0;
+                result_count = 0;
+            }
+            if ((iteration + 1) % check_interval == 0)
+            {
+                int check = play_match(from_theta(theta), start, check_openings, ~(uint64_t)iteration, threads);
+                logger.info(
+                    "Iteration {}: score against the starting parameters {:.1f}%.",
+                    iteration + 1, 50 + 50.0 * check / (2 * check_openings)
+                );
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        logger.info("Tuning finished: {} games in {:.0f} s, {:.1f} games/s, parameters written to {}.", games_played.load(), seconds, games_played / seconds, output);
+    }
+}
\ No newline at end of file
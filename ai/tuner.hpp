@@ -0,0 +1,11 @@
+#pragma once
+
+#include "gomokuai.hpp"
+
+namespace gomokuai
+{
+    // 用 SPSA 调整估值参数: 每轮把当前参数向随机方向正反各扰动一次, 两组参数在全部核心上对弈一批随机开局,
+    // 按胜率之差估计梯度并更新; 每轮结束后写入 output, 中断后再次运行会从 output.progress 继续
+    // iterations 为 0 时一直运行, threads 为 0 时使用全部核心
+    void tune(const string& output, int iterations, int threads);
+}
\ No newline at end of file
@@ -1,14 +1,94 @@
 #pragma once
 
 #include <string>
+#include <chrono>
 
 namespace config
 {
     inline const std::wstring hid_device_name = L"STM32_USBHID";
 
+    // 已发给下位机但尚未收到 ACT_DONE 的命令数上限, 设为 1 即逐条等待应答
+    // 大于 1 要求固件能缓存收到的命令并按顺序执行, 且在 ACT_DONE 中原样返回报告之后的 16 位序号
+    // 现有固件不保证这两点, 多发的命令可能被丢弃或应答无法对应, 因此默认逐条发送
+    inline const int hid_commands_in_flight = 1;
+    // 命令成为最早的未完成命令后, 超过该时间仍未收到 ACT_DONE 即视为失败
+    inline const std::chrono::milliseconds hid_command_timeout{10000};
+
+    // 机械臂运动模型, 运动规划用来估计耗时, 模拟下位机用来模拟动作
+    // 各轴速度 (单位/秒), 到位后的稳定时间, 吸泵动作时间
+    inline const float arm_xy_speed = 200.0f;
+    inline const float arm_z_speed = 50.0f;
+    inline const std::chrono::milliseconds arm_settle_time{100};
+    inline const std::chrono::milliseconds arm_pump_time{300};
+
+    // 模拟下位机在没有按键脚本时对手的落子用时 (毫秒)
+    inline const int simulated_key_delay = 2000;
+
     inline const int video_device_id = 2;
 
+    // 视觉流水线中同时处理的帧数
+    inline const int vision_pipeline_depth = 4;
+
+    // 预览窗口中图像的宽度
+    inline const int preview_width = 1000;
+
+    // 参与投票的最近帧数, 以及每一格多数票的最低占比
+    inline const int consensus_frames = 4;
+    inline const float consensus_threshold = 0.75f;
+
+    // 增量识别: 只检查与上一次确认的帧相比有变化的交叉点
+    inline const bool incremental_recognition = true;
+    // 交叉点平均每通道的差异超过该值视为有变化
+    inline const int incremental_change_threshold = 30;
+    // 连续多少帧与预期不一致后改为整盘识别
+    inline const int incremental_attempts = 5;
+
     inline const int board_size = 11;
 
+    // 各工位共用的 AI 线程数
+    inline const int engine_threads = 2;
+    // AI 估值参数, 启动时加载, 不存在时使用默认值
+    inline const char engine_params_file[] = "engine.params";
+
+    // 工位配置文件, 不存在时只有一个使用默认配置的工位
+    inline const char stations_file[] = "stations.conf";
+
+    // 对局日志, 有多个工位时为 <工位名>.journal; 记录攒够该时间后一起写入磁盘
+    inline const char journal_file[] = "gomoku.journal";
+    inline const std::chrono::milliseconds journal_sync_interval{20};
+
+    // 落子后立即吸起下一颗棋子并悬停在棋盘旁, 缩短 AI 决定后的落子时间
+    inline const bool prefetch_stone = true;
+
+    // 料槽: 每行为 棋盘坐标 (行, 列) 和棋子数, 棋子数为 0 表示自动补充
+    inline const int stone_tray[][3] = {{7, 11, 0}};
+    // 停靠点候选 (棋盘坐标), 需在相机视野的棋盘区域之外, 每次选离下一步可能落点最近的一个
+    inline const int park_points[][2] = {{2, -4}, {5, -4}, {8, -4}};
+    // 预取棋子后的悬停点候选, 紧靠棋盘边缘而不遮挡棋盘, 选法同停靠点
+    inline const int hover_points[][2] = {{2, -2}, {5, -2}, {8, -2}};
+
+    // 标定得到的识别参数, 启动时加载, 不存在时使用默认值
+    inline const char vision_profile[] = "vision.profile";
+    // 标定时每种布局采集的帧数, 以及坐标下降的轮数
+    inline const int calibration_frames = 3;
+    inline const int calibration_passes = 2;
+
     inline const bool trace_mode = true;
+    // 为 false 时 trace 日志在编译时被去掉
+    inline constexpr bool trace_compiled = true;
+
+    // 日志后台线程的输出间隔, 错误和警告会立即唤醒它; 每个线程的日志队列长度 (2 的幂)
+    inline const std::chrono::milliseconds log_flush_interval{10};
+    inline constexpr std::size_t log_queue_capacity = 256;
+
+    // Prometheus textfile 格式的指标导出路径和间隔, 供 node_exporter 等采集
+    inline const char metrics_textfile[] = "gomoku.prom";
+    inline const std::chrono::seconds metrics_export_interval{15};
+
+    // 存档每一步所依据的图像, 超出磁盘预算时删除最早的存档
+    inline const bool archive_enabled = true;
+    inline const char archive_directory[] = "archive";
+    inline const int archive_jpeg_quality = 85;
+    inline const float archive_scale = 0.5f;
+    inline const long long archive_disk_budget = 2LL << 30;
 }
\ No newline at end of file
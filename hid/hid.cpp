@@ -1,8 +1,10 @@
 #include "hid.hpp"
+#include "transport.hpp"
+#include "latency.hpp"
+#include "../tracing.hpp"
 
-#include <hidapi.h>
-#include <thread>
-#include <condition_variable>
+#include <atomic>
+#include <algorithm>
 #include <cstring>
 
 #include "../config.hpp"
@@ -11,15 +13,6 @@ namespace hid
 {
     Logger logger("HID");
 
-    hid_device *device;
-
-    std::mutex act_lock;
-    std::condition_variable act_cond;
-    bool is_action_done = true;
-    std::mutex key_lock;
-    std::condition_variable key_cond;
-    bool active = false;
-
     Report::Report(REPORT_TYPE type): type(type)
     {}
 
@@ -67,128 +60,380 @@ namespace hid
         }
     }
 
-    void send(const Report& report)
+    // 时间线中的事件名
+    const char* report_names[] = {"string", "move XY", "pump", "move Z", "action done", "key down"};
+
+    bool needs_ack(REPORT_TYPE type)
+    {
+        return type == XY_POS || type == PUMP || type == Z_POS;
+    }
+
+    // 序号的低 16 位写在报告之后的空闲字节中, 固件若在 ACT_DONE 中原样返回则用于校验
+    bool Device::write_command(const Command& command)
     {
         unsigned char buf[64]{};
-        memcpy(buf + 1, &report, 60);
-        int bytes = hid_write(device, buf, 64);
+        uint16_t sequence = command.sequence;
+        memcpy(buf + 1, &command.report, sizeof(Report));
+        memcpy(buf + 1 + sizeof(Report), &sequence, sizeof(sequence));
+        int bytes = transport->write(buf, 64);
         if (bytes == -1)
         {
-            logger.error("Failed to send hid report.");
-            logger.error("Reason: {}", hid_error(device));
+            logger.error("Failed to send hid report #{}.", command.sequence);
+            logger.error("Reason: {}", transport->error());
+            return false;
+        }
+        tracing::async_begin(report_names[command.report.type], "hid", trace_id | command.sequence);
+        LOG_TRACE(logger, "{} bytes sent: #{} {}", bytes, command.sequence, (string)command.report);
+        return true;
+    }
+
+    void Device::complete_front(COMMAND_RESULT result)
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto& command = in_flight_commands.front();
+        if (result == COMMAND_DONE && command.awaiting_ack)
+        {
+            round_trip_latency[command.report.type]->observe(now - command.written_at);
+            execution_latency[command.report.type]->observe(now - command.oldest_since);
+        }
+        if (command.awaiting_ack)
+        {
+            tracing::async_end(report_names[command.report.type], "hid", trace_id | command.sequence);
+        }
+        if (command.timing)
+        {
+            if (command.sequence == command.plan)
+            {
+                command.timing->started = command.oldest_since;
+            }
+            command.timing->finished = now;
+        }
+        command.result.set_value(result);
+        in_flight_commands.pop_front();
+        if (!in_flight_commands.empty())
+        {
+            in_flight_commands.front().oldest_since = now;
+        }
+        update_completed();
+    }
+
+    // 最早的未完成命令之前的命令都已完成
+    void Device::update_completed()
+    {
+        if (!in_flight_commands.empty())
+        {
+            completed_sequence = in_flight_commands.front().sequence - 1;
+        }
+        else if (!pending_commands.empty())
+        {
+            completed_sequence = pending_commands.front().sequence - 1;
+        }
+        else
+        {
+            completed_sequence = next_sequence - 1;
+        }
+    }
+
+    void Device::dispatch()
+    {
+        while (active && !pending_commands.empty() && (int)in_flight_commands.size() < config::hid_commands_in_flight)
+        {
+            // 前一个规划全部完成后才发出下一个规划, 它失败时后面的规划还没有发出, 可以放弃
+            if (!in_flight_commands.empty() && in_flight_commands.back().plan != pending_commands.front().plan)
+            {
+                break;
+            }
+            Command command = std::move(pending_commands.front());
+            pending_commands.pop_front();
+            command.written = write_command(command);
+            command.awaiting_ack = command.written && needs_ack(command.report.type);
+            command.written_at = command.oldest_since = std::chrono::steady_clock::now();
+            uint32_t sequence = command.sequence;
+            bool written = command.written;
+            in_flight_commands.push_back(std::move(command));
+            if (!written)
+            {
+                abort_pending(sequence);
+            }
+            // 不需要应答或发送失败的命令不会有应答, 排到最前面时即完成
+            while (!in_flight_commands.empty() && !in_flight_commands.front().awaiting_ack)
+            {
+                complete_front(in_flight_commands.front().written ? COMMAND_DONE : COMMAND_FAILED);
+            }
+        }
+        completion_cond.notify_all();
+    }
+
+    // 有命令失败后, 之后的动作都不能再执行 (如没有移到位就开关吸泵, 吸泵是开关切换, 状态已不可知)
+    // 放弃全部尚未发出的命令, 由提交者重新确认机械臂状态
+    void Device::abort_pending(uint32_t failed)
+    {
+        if (pending_commands.empty())
+        {
             return;
         }
-        switch (report.type)
+        for (auto& command: pending_commands)
         {
-        case XY_POS:
-        case PUMP:
-        case Z_POS:
-            act_lock.lock();
-            is_action_done = false;
-            act_lock.unlock();
-        default:
-            break;
+            command.result.set_value(COMMAND_ABORTED);
+        }
+        logger.warn("Aborted {} queued commands after #{} failed.", pending_commands.size(), failed);
+        pending_commands.clear();
+        update_completed();
+    }
+
+    void Device::abort_all()
+    {
+        for (auto queue: {&in_flight_commands, &pending_commands})
+        {
+            for (auto& command: *queue)
+            {
+                command.result.set_value(COMMAND_ABORTED);
+            }
+            queue->clear();
+        }
+        completed_sequence = next_sequence - 1;
+        completion_cond.notify_all();
+    }
+
+    uint32_t Device::enqueue(const std::vector<Report>& reports, std::vector<std::future<COMMAND_RESULT>>& futures, const std::shared_ptr<PlanTiming>& timing)
+    {
+        auto lock = std::unique_lock(queue_lock);
+        uint32_t plan = next_sequence;
+        for (auto& report: reports)
+        {
+            auto& command = pending_commands.emplace_back();
+            command.sequence = next_sequence++;
+            command.plan = plan;
+            command.report = report;
+            command.timing = timing;
+            futures.push_back(command.result.get_future());
+        }
+        if (!active)
+        {
+            logger.error("HID device is not connected, {} commands dropped.", reports.size());
+            abort_all();
+            return next_sequence - 1;
+        }
+        dispatch();
+        return next_sequence - 1;
+    }
+
+    std::future<COMMAND_RESULT> Device::send_async(const Report& report)
+    {
+        std::vector<std::future<COMMAND_RESULT>> futures;
+        enqueue({report}, futures);
+        return std::move(futures.front());
+    }
+
+    std::vector<std::future<COMMAND_RESULT>> Device::send_plan(const std::vector<Report>& reports, std::shared_ptr<PlanTiming> timing)
+    {
+        std::vector<std::future<COMMAND_RESULT>> futures;
+        enqueue(reports, futures, timing);
+        return futures;
+    }
+
+    uint32_t Device::send(const Report& report)
+    {
+        std::vector<std::future<COMMAND_RESULT>> futures;
+        return enqueue({report}, futures);
+    }
+
+    void Device::acknowledge(uint16_t echoed)
+    {
+        auto lock = std::unique_lock(queue_lock);
+        if (in_flight_commands.empty())
+        {
+            logger.warn("Unexpected action done report.");
+            return;
+        }
+        if (echoed != 0)
+        {
+            auto match = std::find_if(
+                in_flight_commands.begin(), in_flight_commands.end(),
+                [&](const Command& command){ return command.awaiting_ack && (uint16_t)command.sequence == echoed; }
+            );
+            if (match == in_flight_commands.end())
+            {
+                // 已超时放弃的命令迟到的应答
+                logger.warn("Ignoring action done for #{}, which is no longer in flight.", echoed);
+                return;
+            }
+            // 固件按顺序执行, 排在前面的命令已执行完, 只是应答丢失
+            for (auto lost = match - in_flight_commands.begin(); lost > 0; lost--)
+            {
+                auto& command = in_flight_commands.front();
+                logger.warn("Action done for #{} was lost.", command.sequence);
+                complete_front(command.written ? COMMAND_DONE : COMMAND_FAILED);
+            }
+        }
+        complete_front(COMMAND_DONE);
+        dispatch();
+    }
+
+    // 应答丢失或下位机卡住时放弃最早的命令及全部尚未发出的命令
+    // 应答带回序号时, 被放弃的命令迟到的应答会被忽略; 否则后续命令继续按顺序匹配应答
+    void Device::check_timeouts()
+    {
+        auto lock = std::unique_lock(queue_lock);
+        if (in_flight_commands.empty() || std::chrono::steady_clock::now() < in_flight_commands.front().oldest_since + config::hid_command_timeout)
+        {
+            return;
         }
-        logger.trace("{} bytes sent: {}", bytes, (string)report);
+        auto& command = in_flight_commands.front();
+        logger.error("No action done for #{} {} after {} ms.", command.sequence, (string)command.report, config::hid_command_timeout.count());
+        uint32_t sequence = command.sequence;
+        complete_front(COMMAND_TIMED_OUT);
+        abort_pending(sequence);
+        dispatch();
     }
 
-    void receiver_loop()
+    // 持有传输通道的引用, 断开连接之后仍可安全地返回
+    void Device::receiver_loop(std::shared_ptr<Transport> transport)
     {
+        tracing::set_thread_name(instance_name("HID receiver", station_name).c_str());
         unsigned char buf[64];
         while (true)
         {
             memset(buf, 0, 64);
-            int bytes = hid_read(device, buf, 64);
-            if (!active)
+            // 定时醒来检查命令超时
+            int bytes = transport->read(buf, 64, 100);
+            queue_lock.lock();
+            bool current = active && this->transport == transport;
+            queue_lock.unlock();
+            if (!current)
             {
-                logger.trace("Deamon receiver exits.");
+                LOG_TRACE(logger, "Deamon receiver exits.");
                 return;
             }
             if (bytes == -1)
             {
-                logger.error("Error occured when reading from the hid device: {}", hid_error(device));
-                exit();
+                logger.error("Error occured when reading from the hid device: {}", transport->error());
+                disconnect();
                 return;
             }
+            check_timeouts();
+            if (bytes == 0)
+            {
+                continue;
+            }
+            auto received = std::chrono::steady_clock::now();
             Report* report = (Report*)buf;
-            logger.trace("{} bytes received: {}", bytes, (string)*report);
+            LOG_TRACE(logger, "{} bytes received: {}", bytes, (string)*report);
 
             if (report->type == ACT_DONE)
             {
-                act_lock.lock();
-                is_action_done = true;
-                act_lock.unlock();
-                act_cond.notify_all();
+                uint16_t echoed;
+                memcpy(&echoed, buf + sizeof(Report), sizeof(echoed));
+                acknowledge(echoed);
             }
             else if (report->type == KEY_DOWN)
             {
+                key_lock.lock();
+                key_presses++;
+                key_pressed_at = received;
+                tracing::instant("key down", "hid");
+                key_lock.unlock();
                 key_cond.notify_all();
             }
+            dispatch_latency.observe(std::chrono::steady_clock::now() - received);
         }
     }
 
-    void wait_for_action_done()
+    void Device::wait_for(uint32_t sequence)
+    {
+        auto lock = std::unique_lock(queue_lock);
+        completion_cond.wait(lock, [&]{ return completed_sequence >= sequence || !active; });
+    }
+
+    void Device::wait_for_action_done()
     {
-        auto lock = std::unique_lock(act_lock);
-        if (!is_action_done)
+        queue_lock.lock();
+        uint32_t last = next_sequence - 1;
+        queue_lock.unlock();
+        wait_for(last);
+    }
+
+    std::chrono::steady_clock::time_point Device::last_key_time()
+    {
+        auto guard = std::lock_guard(key_lock);
+        return key_pressed_at;
+    }
+
+    bool Device::wait_for_next_key()
+    {
+        auto lock = std::unique_lock(key_lock);
+        uint64_t presses = key_presses;
+        key_cond.wait(lock, [&]{ return key_presses != presses || key_wait_interrupted; });
+        bool pressed = !key_wait_interrupted;
+        if (pressed)
         {
-            act_cond.wait(lock);
+            key_wake_latency.observe(std::chrono::steady_clock::now() - key_pressed_at);
         }
+        key_wait_interrupted = false;
+        return pressed;
+    }
+
+    void Device::interrupt_key_wait()
+    {
+        key_lock.lock();
+        key_wait_interrupted = true;
+        key_lock.unlock();
+        key_cond.notify_all();
     }
 
-    void wait_for_next_key()
+    void Device::clear_key_interrupt()
     {
         auto lock = std::unique_lock(key_lock);
-        key_cond.wait(lock);
+        key_wait_interrupted = false;
     }
 
-    void interrupt_key_wait()
+    std::atomic<uint64_t> device_count = 0;
+
+    Device::Device(const string& station_name, const Options& options):
+        station_name(station_name),
+        logger(instance_name("HID", station_name)),
+        options(options),
+        trace_id(++device_count << 32)
+    {}
+
+    Device::~Device()
     {
-        key_cond.notify_all();
+        exit();
     }
 
-    bool init()
+    bool Device::init()
     {
-        logger.info("Trying to open device {}...", config::hid_device_name.c_str());
-        hid_init();
-        hid_device_info* p_devices = hid_enumerate(0, 0);
-        if (p_devices == NULL)
+        exit();
+        auto opened = options.simulated ? open_simulated_transport(options.key_script) : open_hidapi_transport(options.name, options.serial, device_path);
+        if (!opened)
         {
-            logger.error("Failed to get hid device list.");
-            logger.error("Reason: {}", hid_error(NULL));
             return false;
         }
-        hid_device_info* p_device = p_devices;
-        while (p_device)
-        {
-            logger.trace("HID device: {}", p_device->product_string);
-            if (config::hid_device_name.compare(p_device->product_string) == 0)
-            {
-                device = hid_open(p_device->vendor_id, p_device->product_id, p_device->serial_number);
-                if (!device)
-                {
-                    logger.error("Failed to open device: {}.", p_device->product_string);
-                    logger.error("Reason: {}", hid_error(device));
-                    hid_free_enumeration(p_devices);
-                    return false;
-                }
-                logger.info("Succeeded!");
-                hid_free_enumeration(p_devices);
-                active = true;
-                std::thread(receiver_loop).detach();
-                return true;
-            }
-            p_device = p_device->next;
-        }
-        logger.error("HID device {} not found.", config::hid_device_name.c_str());
-        hid_free_enumeration(p_devices);
-        return false;
+        queue_lock.lock();
+        abort_all();
+        transport = std::move(opened);
+        active = true;
+        queue_lock.unlock();
+        receiver = std::thread(&Device::receiver_loop, this, transport);
+        return true;
     }
 
-    void exit()
+    void Device::disconnect()
     {
+        queue_lock.lock();
         active = false;
-        hid_close(device);
-        hid_exit();
+        abort_all();
+        transport.reset();
+        queue_lock.unlock();
+    }
+
+    void Device::exit()
+    {
+        disconnect();
+        // 接收线程最多 100 ms 后发现连接已断开并退出; 读取出错时它自己调用 disconnect() 后退出, 由这里回收
+        if (receiver.joinable() && receiver.get_id() != std::this_thread::get_id())
+        {
+            receiver.join();
+        }
     }
 }
\ No newline at end of file
@@ -1,5 +1,15 @@
 #pragma once
 
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <chrono>
+
 #include "../logger.hpp"
 
 namespace hid
@@ -42,15 +52,142 @@ namespace hid
         operator string() const;
     };
 
-    bool init();
+    enum COMMAND_RESULT
+    {
+        COMMAND_DONE,
+        COMMAND_FAILED,
+        COMMAND_TIMED_OUT,
+        COMMAND_ABORTED,
+    };
+
+    // 一个规划在下位机上的执行时间: 从第一条命令开始执行 (已发出且之前的命令都已完成) 到最后一条命令完成
+    struct PlanTiming
+    {
+        std::chrono::steady_clock::time_point started, finished;
+    };
+
+    class Transport;
+
+    // 一台下位机的连接: 主机端命令队列, 接收线程与按键状态, 每个工位各有一个
+    class Device
+    {
+    public:
+        struct Options
+        {
+            // USB 设备的产品名, 序列号为空时打开第一台同名设备
+            std::wstring name = config::hid_device_name;
+            std::wstring serial;
+            // 使用模拟的下位机代替 USB 设备
+            bool simulated = false;
+            string key_script;
+        };
+
+        Device(const string& station_name, const Options& options);
+
+        ~Device();
 
-    void exit();
+        Device(const Device&) = delete;
+        Device& operator=(const Device&) = delete;
 
-    void send(const Report&);
+        // 已连接时先断开再重新连接
+        bool init();
 
-    void wait_for_action_done();
+        void exit();
+
+        // 把命令加入发送队列, 收到应答, 发送失败, 超时或断开连接时 future 就绪
+        std::future<COMMAND_RESULT> send_async(const Report&);
+
+        // 把一串命令作为一个规划整体加入发送队列; 不同规划的命令不会同时在途
+        // 其中一条发送失败或超时后, 队列中尚未发出的全部命令 (包括之后提交的规划) 都不再发送
+        // timing 不为空时记录执行时间, 全部 future 就绪后可读
+        std::vector<std::future<COMMAND_RESULT>> send_plan(const std::vector<Report>&, std::shared_ptr<PlanTiming> timing = {});
+
+        // 把命令加入发送队列并立即返回命令序号, 队列按序发出, 已发出未完成的命令数不超过设定的窗口
+        uint32_t send(const Report&);
+
+        // 等待指定序号及之前的全部命令完成
+        void wait_for(uint32_t sequence);
+
+        // 等待目前已提交的全部命令完成
+        void wait_for_action_done();
+
+        // 返回 false 表示被 interrupt_key_wait() 中断
+        bool wait_for_next_key();
+
+        void interrupt_key_wait();
+
+        // 放弃尚未生效的中断
+        void clear_key_interrupt();
+
+        // 最近一次收到 KEY_DOWN 的时间
+        std::chrono::steady_clock::time_point last_key_time();
+
+    private:
+        // 主机端命令队列: 每条命令按提交顺序编号, 最多 config::hid_commands_in_flight 条已发出而未完成
+        // 固件按顺序执行, 每条运动命令完成后回复一次 ACT_DONE; 应答带回序号时按序号匹配, 否则依次对应最早发出的命令
+        struct Command
+        {
+            uint32_t sequence;
+            // 所属规划第一条命令的序号
+            uint32_t plan;
+            Report report;
+            bool written;
+            bool awaiting_ack;
+            std::chrono::steady_clock::time_point written_at;
+            // 成为最早的未完成命令的时间, 超时从这里开始计算, 之前的命令执行时间不计入
+            std::chrono::steady_clock::time_point oldest_since;
+            std::promise<COMMAND_RESULT> result;
+            std::shared_ptr<PlanTiming> timing;
+        };
+
+        const string station_name;
+        Logger logger;
+        const Options options;
+        // 时间线中异步事件 id 的高位, 区分各设备的命令序号
+        const uint64_t trace_id;
+
+        // 上次打开的 USB 设备路径, 重新连接时直接使用
+        string device_path;
+        std::shared_ptr<Transport> transport;
+        std::thread receiver;
+
+        std::mutex queue_lock;
+        std::condition_variable completion_cond;
+        std::deque<Command> pending_commands;
+        std::deque<Command> in_flight_commands;
+        uint32_t next_sequence = 1;
+        uint32_t completed_sequence = 0;
+        bool active = false;
+
+        std::mutex key_lock;
+        std::condition_variable key_cond;
+        uint64_t key_presses = 0;
+        std::chrono::steady_clock::time_point key_pressed_at;
+        // 中断在下一次等待时生效, 即使当时没有线程在等待
+        bool key_wait_interrupted = false;
+
+        bool write_command(const Command& command);
+
+        // 以下函数调用时需持有 queue_lock
+        void complete_front(COMMAND_RESULT result);
+        void update_completed();
+        void dispatch();
+        void abort_pending(uint32_t failed);
+        void abort_all();
+
+        // 返回最后一条命令的序号
+        uint32_t enqueue(const std::vector<Report>& reports, std::vector<std::future<COMMAND_RESULT>>& futures, const std::shared_ptr<PlanTiming>& timing = {});
+        void acknowledge(uint16_t echoed);
+        void check_timeouts();
+        void receiver_loop(std::shared_ptr<Transport> transport);
+        // 停止收发并放弃全部命令, 不等待接收线程
+        void disconnect();
+    };
 
-    void wait_for_next_key();
+    // 各类命令的往返与执行延迟, 接收线程的处理延迟, 以及按键到唤醒的延迟
+    // 这些直方图也在 metrics::summary() 和导出的指标中
+    string latency_summary();
 
-    void interrupt_key_wait();
+    // 把延迟直方图以 Prometheus 文本格式写入文件
+    bool dump_latency(const string& path);
 }
\ No newline at end of file
@@ -0,0 +1,126 @@
+#include "transport.hpp"
+
+#include <mutex>
+#include <set>
+#include <hidapi.h>
+
+#include "../config.hpp"
+
+namespace hid
+{
+    std::mutex hidapi_lock;
+    int open_count = 0;
+    // 各工位已打开的设备路径, 没有配置序列号的工位不能打开同一台设备
+    std::set<string> open_paths;
+
+    class HidapiTransport: public Transport
+    {
+        hid_device* device;
+        const string path;
+
+    public:
+        HidapiTransport(hid_device* device, const string& path): device(device), path(path)
+        {
+            open_count++;
+            open_paths.insert(path);
+        }
+
+        ~HidapiTransport()
+        {
+            auto guard = std::lock_guard(hidapi_lock);
+            hid_close(device);
+            open_paths.erase(path);
+            // 多个工位各自打开设备, 最后一个关闭时才释放 hidapi
+            if (--open_count == 0)
+            {
+                hid_exit();
+            }
+        }
+
+        int write(const unsigned char* buf, std::size_t length) override
+        {
+            return hid_write(device, buf, length);
+        }
+
+        int read(unsigned char* buf, std::size_t length, int milliseconds) override
+        {
+            return hid_read_timeout(device, buf, length, milliseconds);
+        }
+
+        const wchar_t* error() override
+        {
+            return hid_error(device);
+        }
+    };
+
+    // 路径对应的设备可能已被拔出并换成了另一台, 打开后再核对产品名和序列号
+    bool is_expected_device(hid_device* device, const std::wstring& name, const std::wstring& serial)
+    {
+        wchar_t buf[256];
+        if (hid_get_product_string(device, buf, std::size(buf)) != 0 || name.compare(buf) != 0)
+        {
+            return false;
+        }
+        return serial.empty() || (hid_get_serial_number_string(device, buf, std::size(buf)) == 0 && serial.compare(buf) == 0);
+    }
+
+    std::unique_ptr<Transport> open_hidapi_transport(const std::wstring& name, const std::wstring& serial, string& path)
+    {
+        // hidapi 的枚举与初始化不是线程安全的
+        auto guard = std::lock_guard(hidapi_lock);
+        hid_init();
+        // 重新连接时不必枚举全部 HID 设备
+        if (!path.empty() && !open_paths.contains(path))
+        {
+            hid_device* device = hid_open_path(path.c_str());
+            if (device && is_expected_device(device, name, serial))
+            {
+                logger.info("Reopened device {}.", path);
+                return std::make_unique<HidapiTransport>(device, path);
+            }
+            if (device)
+            {
+                hid_close(device);
+            }
+            logger.warn("Cannot reopen device {}, searching again.", path);
+            path.clear();
+        }
+        logger.info("Trying to open device {} {}...", name.c_str(), serial.c_str());
+        hid_device_info* p_devices = hid_enumerate(0, 0);
+        if (p_devices == NULL)
+        {
+            logger.error("Failed to get hid device list.");
+            logger.error("Reason: {}", hid_error(NULL));
+            return nullptr;
+        }
+        hid_device_info* p_device = p_devices;
+        while (p_device)
+        {
+            LOG_TRACE(logger, "HID device: {}", p_device->product_string);
+            bool serial_matches = serial.empty() || (p_device->serial_number && serial.compare(p_device->serial_number) == 0);
+            if (name.compare(p_device->product_string) == 0 && serial_matches && open_paths.contains(p_device->path))
+            {
+                logger.info("Skipping device {}, which another station has opened.", p_device->path);
+            }
+            else if (name.compare(p_device->product_string) == 0 && serial_matches)
+            {
+                hid_device* device = hid_open_path(p_device->path);
+                if (!device)
+                {
+                    logger.error("Failed to open device: {}.", p_device->product_string);
+                    logger.error("Reason: {}", hid_error(device));
+                    hid_free_enumeration(p_devices);
+                    return nullptr;
+                }
+                logger.info("Succeeded!");
+                path = p_device->path;
+                hid_free_enumeration(p_devices);
+                return std::make_unique<HidapiTransport>(device, path);
+            }
+            p_device = p_device->next;
+        }
+        logger.error("HID device {} {} not found.", name.c_str(), serial.c_str());
+        hid_free_enumeration(p_devices);
+        return nullptr;
+    }
+}
\ No newline at end of file
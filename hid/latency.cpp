@@ -0,0 +1,88 @@
+#include "latency.hpp"
+
+#include <fstream>
+
+namespace hid
+{
+    // 100 微秒到约 13 秒, 覆盖从 USB 往返到命令超时
+    const auto latency_buckets = metrics::exponential_buckets(0.0001, 2, 18);
+
+    metrics::Histogram* command_histogram(REPORT_TYPE type, const char* kind, const char* help)
+    {
+        const char* names[] = {nullptr, "xy_pos", "pump", "z_pos", nullptr, nullptr};
+        if (!names[type])
+        {
+            return nullptr;
+        }
+        return &metrics::histogram(
+            format("gomoku_hid_{}_{}_seconds", names[type], kind), format("{} for {} commands", help, names[type]), latency_buckets
+        );
+    }
+
+    metrics::Histogram* const round_trip_latency[KEY_DOWN + 1] = {
+        nullptr,
+        command_histogram(XY_POS, "round_trip", "Time from writing a command to its action done"),
+        command_histogram(PUMP, "round_trip", "Time from writing a command to its action done"),
+        command_histogram(Z_POS, "round_trip", "Time from writing a command to its action done"),
+        nullptr, nullptr,
+    };
+    metrics::Histogram* const execution_latency[KEY_DOWN + 1] = {
+        nullptr,
+        command_histogram(XY_POS, "execution", "Time from becoming the oldest outstanding command to its action done"),
+        command_histogram(PUMP, "execution", "Time from becoming the oldest outstanding command to its action done"),
+        command_histogram(Z_POS, "execution", "Time from becoming the oldest outstanding command to its action done"),
+        nullptr, nullptr,
+    };
+    metrics::Histogram& dispatch_latency = metrics::histogram(
+        "gomoku_hid_dispatch_seconds", "Time from reading a report to finishing handling it", latency_buckets
+    );
+    metrics::Histogram& key_wake_latency = metrics::histogram(
+        "gomoku_hid_key_wake_seconds", "Time from receiving a key press to the waiting thread waking up", latency_buckets
+    );
+
+    const REPORT_TYPE command_types[] = {XY_POS, PUMP, Z_POS};
+
+    std::vector<const metrics::Histogram*> latency_histograms()
+    {
+        std::vector<const metrics::Histogram*> histograms;
+        for (auto type: command_types)
+        {
+            histograms.push_back(round_trip_latency[type]);
+            histograms.push_back(execution_latency[type]);
+        }
+        histograms.push_back(&dispatch_latency);
+        histograms.push_back(&key_wake_latency);
+        return histograms;
+    }
+
+    string latency_summary()
+    {
+        string text;
+        for (auto histogram: latency_histograms())
+        {
+            if (!text.empty())
+            {
+                text.push_back('\n');
+            }
+            text.append(histogram->summary());
+        }
+        return text;
+    }
+
+    bool dump_latency(const string& path)
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            logger.error("Cannot write latency histograms to {}.", path);
+            return false;
+        }
+        string text;
+        for (auto histogram: latency_histograms())
+        {
+            histogram->write_prometheus(text);
+        }
+        file << text;
+        return (bool)file;
+    }
+}
\ No newline at end of file
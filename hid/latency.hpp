@@ -0,0 +1,19 @@
+#pragma once
+
+#include "../metrics.hpp"
+#include "hid.hpp"
+
+namespace hid
+{
+    // 以下直方图注册在 metrics 中, 以秒记录, 与其他指标一起汇总和导出
+    // 只有需要应答的命令 (XY_POS, PUMP, Z_POS) 有直方图, 其余类型为空指针
+
+    // 写入到收到 ACT_DONE 的时间
+    extern metrics::Histogram* const round_trip_latency[KEY_DOWN + 1];
+    // 成为最早的未完成命令到收到 ACT_DONE 的时间, 即下位机执行的时间
+    extern metrics::Histogram* const execution_latency[KEY_DOWN + 1];
+    // 读到报告到处理完毕 (唤醒等待者, 发出后续命令) 的时间
+    extern metrics::Histogram& dispatch_latency;
+    // 收到 KEY_DOWN 到等待按键的线程醒来的时间
+    extern metrics::Histogram& key_wake_latency;
+}
\ No newline at end of file
@@ -0,0 +1,206 @@
+#include "transport.hpp"
+
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <optional>
+#include <array>
+#include <vector>
+#include <fstream>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "../config.hpp"
+
+namespace hid
+{
+    class SimulatedTransport: public Transport
+    {
+        using clock = std::chrono::steady_clock;
+        using Packet = std::array<unsigned char, 64>;
+
+        std::mutex lock;
+        std::condition_variable command_cond, reply_cond;
+        std::deque<Packet> commands, replies;
+        bool stopping = false;
+        std::thread arm_thread;
+
+        float x = 0, y = 0, z = 0;
+        bool pump_on = false;
+
+        std::vector<int> key_delays;
+        std::size_t next_key = 0;
+
+        std::chrono::milliseconds travel_time(float distance, float speed)
+        {
+            return std::chrono::milliseconds((long long)(1000 * distance / speed));
+        }
+
+        std::chrono::milliseconds execute(const Report& report)
+        {
+            switch (report.type)
+            {
+            case XY_POS:
+            {
+                float distance = std::hypot(report.data.xy_pos.x - x, report.data.xy_pos.y - y);
+                x = report.data.xy_pos.x;
+                y = report.data.xy_pos.y;
+                return travel_time(distance, config::arm_xy_speed) + config::arm_settle_time;
+            }
+            case Z_POS:
+            {
+                float distance = std::abs(report.data.z_pos - z);
+                z = report.data.z_pos;
+                return travel_time(distance, config::arm_z_speed) + config::arm_settle_time;
+            }
+            case PUMP:
+                pump_on = !pump_on;
+                return config::arm_pump_time;
+            default:
+                return std::chrono::milliseconds(0);
+            }
+        }
+
+        void reply(REPORT_TYPE type, uint16_t sequence)
+        {
+            Packet packet{};
+            Report report(type);
+            memcpy(packet.data(), &report, sizeof(Report));
+            memcpy(packet.data() + sizeof(Report), &sequence, sizeof(sequence));
+            auto guard = std::lock_guard(lock);
+            replies.push_back(packet);
+            reply_cond.notify_all();
+        }
+
+        // 下位机按顺序执行命令, 每条运动命令完成后回复 ACT_DONE 并带回序号
+        // 吸泵关闭 (放下棋子) 后机械臂再次停下时, 延时模拟对手落子并按键
+        void arm_loop()
+        {
+            bool key_owed = false;
+            std::optional<clock::time_point> key_time;
+            auto guard = std::unique_lock(lock);
+            while (!stopping)
+            {
+                if (commands.empty())
+                {
+                    bool has_key = key_delays.empty() || next_key < key_delays.size();
+                    if (key_owed && has_key && !key_time)
+                    {
+                        int delay = key_delays.empty() ? config::simulated_key_delay : key_delays[next_key];
+                        key_time = clock::now() + std::chrono::milliseconds(delay);
+                    }
+                    if (!key_time)
+                    {
+                        command_cond.wait(guard);
+                        continue;
+                    }
+                    command_cond.wait_until(guard, *key_time);
+                    if (commands.empty() && !stopping && clock::now() >= *key_time)
+                    {
+                        key_time.reset();
+                        key_owed = false;
+                        next_key++;
+                        guard.unlock();
+                        reply(KEY_DOWN, 0);
+                        guard.lock();
+                    }
+                    continue;
+                }
+                // 按键前机械臂又有动作时, 等它再次停下后重新计时
+                key_time.reset();
+
+                Packet packet = commands.front();
+                commands.pop_front();
+                Report report;
+                uint16_t sequence;
+                memcpy(&report, packet.data() + 1, sizeof(Report));
+                memcpy(&sequence, packet.data() + 1 + sizeof(Report), sizeof(sequence));
+                guard.unlock();
+
+                auto duration = execute(report);
+                std::this_thread::sleep_for(duration);
+                LOG_TRACE(logger, "Simulated {} in {} ms.", (string)report, duration.count());
+                if (report.type == PUMP && !pump_on)
+                {
+                    key_owed = true;
+                }
+                if (report.type == XY_POS || report.type == PUMP || report.type == Z_POS)
+                {
+                    reply(ACT_DONE, sequence);
+                }
+                guard.lock();
+            }
+        }
+
+    public:
+        SimulatedTransport(std::vector<int>&& key_delays): key_delays(std::move(key_delays))
+        {
+            arm_thread = std::thread(&SimulatedTransport::arm_loop, this);
+        }
+
+        ~SimulatedTransport()
+        {
+            lock.lock();
+            stopping = true;
+            lock.unlock();
+            command_cond.notify_all();
+            reply_cond.notify_all();
+            arm_thread.join();
+        }
+
+        int write(const unsigned char* buf, std::size_t length) override
+        {
+            Packet packet{};
+            memcpy(packet.data(), buf, std::min(length, packet.size()));
+            auto guard = std::lock_guard(lock);
+            commands.push_back(packet);
+            command_cond.notify_all();
+            return length;
+        }
+
+        int read(unsigned char* buf, std::size_t length, int milliseconds) override
+        {
+            auto guard = std::unique_lock(lock);
+            if (!reply_cond.wait_for(guard, std::chrono::milliseconds(milliseconds), [&]{ return !replies.empty() || stopping; }))
+            {
+                return 0;
+            }
+            if (replies.empty())
+            {
+                return 0;
+            }
+            int bytes = std::min(length, replies.front().size());
+            memcpy(buf, replies.front().data(), bytes);
+            replies.pop_front();
+            return bytes;
+        }
+
+        const wchar_t* error() override
+        {
+            return L"simulated device";
+        }
+    };
+
+    std::unique_ptr<Transport> open_simulated_transport(const string& key_script)
+    {
+        std::vector<int> key_delays;
+        if (!key_script.empty())
+        {
+            std::ifstream file(key_script);
+            if (!file)
+            {
+                logger.error("Cannot open key script {}.", key_script);
+                return nullptr;
+            }
+            int delay;
+            while (file >> delay)
+            {
+                key_delays.push_back(delay);
+            }
+            logger.info("Simulated device will press the key {} times.", key_delays.size());
+        }
+        logger.info("Using the simulated device.");
+        return std::make_unique<SimulatedTransport>(std::move(key_delays));
+    }
+}
\ No newline at end of file
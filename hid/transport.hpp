@@ -0,0 +1,32 @@
+#pragma once
+
+#include <memory>
+
+#include "hid.hpp"
+
+namespace hid
+{
+    // 与下位机之间收发 64 字节报告的通道, 读写各只在一个线程中调用
+    class Transport
+    {
+    public:
+        virtual ~Transport() = default;
+
+        // 与 hid_write 相同, buf[0] 为报告 ID, 返回写入的字节数, 失败返回 -1
+        virtual int write(const unsigned char* buf, std::size_t length) = 0;
+
+        // 与 hid_read_timeout 相同, 超时返回 0, 失败返回 -1
+        virtual int read(unsigned char* buf, std::size_t length, int milliseconds) = 0;
+
+        virtual const wchar_t* error() = 0;
+    };
+
+    // 打开产品名为 name 的 USB HID 设备, serial 不为空时还要求序列号相同, 失败时返回空指针
+    // 跳过本进程中已由其他 Device 打开的设备
+    // path 为上次打开的设备路径, 不为空时先直接打开它, 成功打开后更新为本次的路径
+    std::unique_ptr<Transport> open_hidapi_transport(const std::wstring& name, const std::wstring& serial, string& path);
+
+    // 不连接硬件, 按距离和速度模拟机械臂动作并回复 ACT_DONE, 每放下一颗棋子后模拟一次按键
+    // key_script 每行为一次按键相对机械臂停下的延时 (毫秒), 为空时使用固定延时
+    std::unique_ptr<Transport> open_simulated_transport(const string& key_script);
+}
\ No newline at end of file
@@ -0,0 +1,187 @@
+#include "logger.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+
+#include "spsc_queue.hpp"
+
+namespace
+{
+    const char* level_names[] = {
+        "\033[1m\033[31m[ERROR]\033[0m",
+        "\033[33m[WARN]\033[0m",
+        "[INFO]",
+        "\033[32m[TRACE]\033[0m",
+    };
+
+    void write_record(const Logger::Record& record)
+    {
+        auto& os = record.level == Logger::ERROR ? std::cerr : std::cout;
+        os << level_names[record.level] << '[' << record.module_name << "]: ";
+        os.write(record.text, record.length);
+        os << record.overflow << '\n';
+    }
+
+    struct ThreadQueue
+    {
+        SpscQueue<Logger::Record, config::log_queue_capacity> records;
+        std::atomic<uint64_t> dropped{0};
+        // 线程退出后由后台线程在取空后移除
+        std::atomic<bool> retired{false};
+    };
+
+    // 后台线程析构后改为直接输出, 保证退出过程中的日志不丢失
+    std::atomic<bool> backend_running{false};
+
+    class Backend
+    {
+        std::mutex lock;
+        std::condition_variable wake_cond;
+        std::vector<std::shared_ptr<ThreadQueue>> queues;
+        bool stopping = false;
+        bool wake = false;
+        std::thread thread;
+
+        std::vector<Logger::Record> batch;
+
+        void drain()
+        {
+            std::vector<std::shared_ptr<ThreadQueue>> snapshot;
+            {
+                auto guard = std::lock_guard(lock);
+                snapshot = queues;
+            }
+            uint64_t dropped = 0;
+            Logger::Record record;
+            for (auto& queue: snapshot)
+            {
+                while (queue->records.pop(record))
+                {
+                    batch.push_back(std::move(record));
+                }
+                dropped += queue->dropped.exchange(0, std::memory_order_relaxed);
+            }
+            // 各线程的队列内部有序, 合并后按时间排序
+            std::stable_sort(batch.begin(), batch.end(), [](auto& a, auto& b){ return a.time < b.time; });
+            for (auto& record: batch)
+            {
+                write_record(record);
+            }
+            if (dropped > 0)
+            {
+                std::cout << level_names[Logger::WARN] << "[Logger]: " << dropped << " log records dropped.\n";
+            }
+            if (!batch.empty())
+            {
+                std::cout.flush();
+                std::cerr.flush();
+            }
+            batch.clear();
+
+            auto guard = std::lock_guard(lock);
+            std::erase_if(queues, [](auto& queue){ return queue->retired && queue->records.size() == 0; });
+        }
+
+        void run()
+        {
+            while (true)
+            {
+                {
+                    auto guard = std::unique_lock(lock);
+                    wake_cond.wait_for(guard, config::log_flush_interval, [&]{ return wake || stopping; });
+                    wake = false;
+                    if (stopping)
+                    {
+                        break;
+                    }
+                }
+                drain();
+            }
+            drain();
+        }
+
+    public:
+        Backend()
+        {
+            batch.reserve(config::log_queue_capacity);
+            thread = std::thread(&Backend::run, this);
+            backend_running = true;
+        }
+
+        ~Backend()
+        {
+            backend_running = false;
+            notify(true);
+            thread.join();
+        }
+
+        void add(const std::shared_ptr<ThreadQueue>& queue)
+        {
+            auto guard = std::lock_guard(lock);
+            queues.push_back(queue);
+        }
+
+        void notify(bool stop = false)
+        {
+            {
+                auto guard = std::lock_guard(lock);
+                wake = true;
+                stopping |= stop;
+            }
+            wake_cond.notify_one();
+        }
+    };
+
+    Backend& backend()
+    {
+        static Backend instance;
+        return instance;
+    }
+
+    ThreadQueue& thread_queue()
+    {
+        thread_local struct Holder
+        {
+            std::shared_ptr<ThreadQueue> queue = std::make_shared<ThreadQueue>();
+
+            Holder()
+            {
+                backend().add(queue);
+            }
+
+            ~Holder()
+            {
+                queue->retired = true;
+            }
+        } holder;
+        return *holder.queue;
+    }
+}
+
+void Logger::submit(Record&& record)
+{
+    backend();
+    if (!backend_running)
+    {
+        write_record(record);
+        (record.level == ERROR ? std::cerr : std::cout).flush();
+        return;
+    }
+    auto& queue = thread_queue();
+    // 错误和警告, 或队列过半时立即唤醒后台线程
+    bool urgent = record.level <= WARN || queue.records.size() >= config::log_queue_capacity / 2;
+    if (!queue.records.push(std::move(record)))
+    {
+        queue.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (urgent)
+    {
+        backend().notify();
+    }
+}
\ No newline at end of file
@@ -3,18 +3,79 @@
 #include <string>
 #include <format>
 #include <iostream>
+#include <chrono>
 
 #include "config.hpp"
 
 using std::string;
 using std::format;
 
+// 每个工位各有一份的模块实例的名字, 如 "HID left", 用于日志和线程名; 实例名为空时即为模块名
+inline string instance_name(const string& module, const string& instance)
+{
+    return instance.empty() ? module : format("{} {}", module, instance);
+}
+
+// trace 日志: 编译时关闭 (config::trace_compiled) 时整条语句连同参数一起被消除,
+// 运行时关闭 (trace_mode) 时参数也不会被求值, 因此参数中不能有副作用
+#define LOG_TRACE(logger, ...) \
+    do \
+    { \
+        if constexpr (config::trace_compiled) \
+        { \
+            if ((logger).trace_mode) \
+            { \
+                (logger).trace(__VA_ARGS__); \
+            } \
+        } \
+    } \
+    while (false)
+
 class Logger
 {
-    void print(std::ostream& os, string&& info_type, string&& message) const
+public:
+    enum LEVEL
+    {
+        ERROR,
+        WARN,
+        INFO,
+        TRACE,
+    };
+
+    // 调用线程只格式化消息并放入本线程的无锁环形队列, 由后台线程按时间顺序批量输出
+    // 模块名也复制进记录, Logger 在记录输出前析构也没有关系
+    struct Record
+    {
+        std::chrono::steady_clock::time_point time;
+        LEVEL level;
+        char module_name[32];
+        uint16_t length;
+        char text[200];
+        // 超出 text 的部分, 只有很长的消息才会分配内存
+        string overflow;
+    };
+
+    // 队列已满时丢弃并计数, 后台线程停止后直接输出
+    static void submit(Record&& record);
+
+private:
+    template <typename ... Args_t>
+    void print(LEVEL level, std::format_string<Args_t...> fmt_str, Args_t && ... args) const
     {
-        os << std::format("{}[{}]: {}\n", info_type, module_name, message);
-        os.flush();
+        Record record;
+        record.time = std::chrono::steady_clock::now();
+        record.level = level;
+        // 过长的名字截断
+        auto name_length = module_name.copy(record.module_name, sizeof(record.module_name) - 1);
+        record.module_name[name_length] = '\0';
+        // format 只读取参数, 转发两次不会使参数失效
+        auto result = std::format_to_n(record.text, sizeof(record.text), fmt_str, std::forward<Args_t>(args)...);
+        record.length = std::min<std::size_t>(result.size, sizeof(record.text));
+        if (result.size > (std::ptrdiff_t)sizeof(record.text))
+        {
+            record.overflow = format(fmt_str, std::forward<Args_t>(args)...).substr(sizeof(record.text));
+        }
+        submit(std::move(record));
     }
 
     template <typename TrueType, typename FalseType, bool>
@@ -73,27 +134,31 @@ public:
     template <typename ... Args_t>
     void error(std::format_string<format_arg_t<Args_t>...> fmt_str, Args_t && ... args) const
     {
-        return print(std::cerr, "\033[1m\033[31m[ERROR]\033[0m", format(fmt_str, forward_format_arg<Args_t>(args)...));
+        return print<format_arg_t<Args_t>...>(ERROR, fmt_str, forward_format_arg<Args_t>(args)...);
     }
 
     template <typename ... Args_t>
     void warn(std::format_string<format_arg_t<Args_t>...> fmt_str, Args_t && ... args) const
     {
-        return print(std::cout, "\033[33m[WARN]\033[0m", format(fmt_str, forward_format_arg<Args_t>(args)...));
+        return print<format_arg_t<Args_t>...>(WARN, fmt_str, forward_format_arg<Args_t>(args)...);
     }
 
     template <typename ... Args_t>
     void info(std::format_string<format_arg_t<Args_t>...> fmt_str, Args_t && ... args) const
     {
-        return print(std::cout, "[INFO]", format(fmt_str, forward_format_arg<Args_t>(args)...));
+        return print<format_arg_t<Args_t>...>(INFO, fmt_str, forward_format_arg<Args_t>(args)...);
     }
 
+    // 参数在调用处求值, 日志关闭时也有开销, 应通过 LOG_TRACE 调用
     template <typename ... Args_t>
     void trace(std::format_string<format_arg_t<Args_t>...> fmt_str, Args_t && ... args) const
     {
-        if (trace_mode)
+        if constexpr (config::trace_compiled)
         {
-            return print(std::cout, "\033[32m[TRACE]\033[0m", format(fmt_str, forward_format_arg<Args_t>(args)...));
+            if (trace_mode)
+            {
+                return print<format_arg_t<Args_t>...>(TRACE, fmt_str, forward_format_arg<Args_t>(args)...);
+            }
         }
     }
 };
\ No newline at end of file
@@ -1,171 +1,298 @@
 #include "ai/gomokuai.hpp"
+#include "ai/pool.hpp"
+#include "ai/batch.hpp"
+#include "ai/tuner.hpp"
 #include "opencv/opencv.hpp"
 #include "hid/hid.hpp"
+#include "station/station.hpp"
+#include "tracing.hpp"
+#include "metrics.hpp"
 
-#include <thread>
+#include <memory>
+#include <future>
 #include <fstream>
+#include <ctime>
 
 static Logger logger("main");
 
 float kx, ky, bx, by;
-gomokuai::PIECE_TYPE ai_type = gomokuai::BLACK;
-bool is_playing = false;
 
-gomokuai::Coord_2D stone_fetch_point{7, 11};
-gomokuai::Coord_2D idle_point{5, -4};
-
-const char tmp_file_name[] = "coefs.tmp";
-
-hid::Report convert(gomokuai::Coord_2D point)
-{
-    return {kx * point.row + bx, ky * point.col + by};
-}
-
-void func()
+int main(int argc, char *argv[])
 {
-    int count = 0;
-    if (ai_type == gomokuai::WHITE)
+    if (argc > 1 && strcmp(argv[1], "aitest") == 0)
     {
-        count = 1;
-        hid::wait_for_next_key();
+        opencv::test();
+        return 0;
     }
-    while (is_playing)
+    // visionbench [帧数] [随机种子] [识别参数文件] [分辨率比例]
+    if (argc > 1 && strcmp(argv[1], "visionbench") == 0)
     {
-        auto pos = opencv::get_ai_step(count);
-        logger.trace("AI point: {}, {}.", pos.row, pos.col);
-        hid::send(convert(stone_fetch_point));
-        hid::wait_for_action_done();
-        hid::send(hid::PUMP);
-        hid::wait_for_action_done();
-        hid::send(convert(pos));
-        hid::wait_for_action_done();
-        hid::send(hid::PUMP);
-        hid::wait_for_action_done();
-        hid::send(convert(idle_point));
-        hid::wait_for_action_done();
-        count += 2;
-        hid::wait_for_next_key();
+        opencv::vision_benchmark(
+            argc > 2 ? atoi(argv[2]) : 1000, argc > 3 ? atoll(argv[3]) : 0,
+            argc > 4 ? argv[4] : config::vision_profile, argc > 5 ? atof(argv[5]) : 1
+        );
+        return 0;
     }
-}
-
-int main(int argc, char *argv[])
-{
-    if (argc > 1 && strcmp(argv[1], "aitest") == 0)
+    // replay <录制文件> [识别参数文件]: 工位的 profile 不同时需指定该工位的文件
+    if (argc > 2 && strcmp(argv[1], "replay") == 0)
     {
-        opencv::test();
+        opencv::replay(argv[2], argc > 3 ? argv[3] : config::vision_profile);
         return 0;
     }
-    if (!hid::init())
+    // analyse <局面文件> [输出文件] [线程数]: 不连接硬件, 批量分析局面
+    if (argc > 2 && strcmp(argv[1], "analyse") == 0)
     {
-        logger.error("Error occured, exiting.");
-        hid::exit();
-        return -1;
+        auto analysed = gomokuai::analyse_file(argv[2], argc > 3 ? argv[3] : "analysis.csv", argc > 4 ? atoi(argv[4]) : 0);
+        return analysed < 0 ? -1 : 0;
     }
-    if (!opencv::init())
+    // tune [输出文件] [轮数] [线程数]: 不连接硬件, 自我对弈调整估值参数
+    if (argc > 1 && strcmp(argv[1], "tune") == 0)
+    {
+        gomokuai::tune(argc > 2 ? argv[2] : "tuned.params", argc > 3 ? atoi(argv[3]) : 0, argc > 4 ? atoi(argv[4]) : 0);
+        return 0;
+    }
+    auto settings = station::load_settings(config::stations_file);
+    // simulate [录制文件] [按键脚本]: 所有工位都用模拟的下位机和录制的帧完整地下棋
+    if (argc > 1 && strcmp(argv[1], "simulate") == 0)
+    {
+        for (auto& station: settings)
+        {
+            station.device.simulated = true;
+            station.device.key_script = argc > 3 ? argv[3] : "";
+            station.camera.recording = argc > 2 ? argv[2] : "";
+        }
+    }
+    // 各工位与 AI 的初始化互不依赖, 同时进行, 全部完成后才开始接受命令
+    auto startup_begin = std::chrono::steady_clock::now();
+    auto elapsed_ms = [&]{ return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startup_begin).count(); };
+    auto engine_ready = std::async(std::launch::async, [&]
+    {
+        gomokuai::EngineParams params;
+        if (gomokuai::load_params(config::engine_params_file, params))
+        {
+            gomokuai::set_params(params);
+            logger.info("Engine parameters loaded from {}.", config::engine_params_file);
+        }
+        gomokuai::init();
+        gomokuai::pool_start(config::engine_threads);
+        logger.info("Engine ready after {} ms.", elapsed_ms());
+    });
+    std::vector<std::unique_ptr<station::Station>> stations;
+    std::vector<std::future<bool>> stations_ready;
+    for (auto& station: settings)
+    {
+        stations.push_back(std::make_unique<station::Station>(station));
+        stations_ready.push_back(std::async(std::launch::async, &station::Station::init, stations.back().get()));
+    }
+    bool ready = true;
+    for (auto& station_ready: stations_ready)
+    {
+        ready &= station_ready.get();
+    }
+    engine_ready.get();
+    if (!ready)
     {
         logger.error("Error occured, exiting.");
-        opencv::exit();
-        hid::exit();
+        gomokuai::pool_stop();
+        for (auto& station: stations)
+        {
+            station->exit();
+        }
         return -1;
     }
-    gomokuai::init();
-    std::vector<std::pair<std::pair<float, float>, std::pair<int, int>>> m;
-    std::pair<float, float> tmp, p;
-    std::thread player;
+    logger.info("{} stations started in {} ms.", stations.size(), elapsed_ms());
+    metrics::start_export(config::metrics_textfile);
+    // 各工位手动移动到的位置和记下的标定点, 切换工位后互不影响
+    struct Jog
+    {
+        std::vector<std::pair<std::pair<float, float>, std::pair<int, int>>> m;
+        std::pair<float, float> p;
+    };
+    std::vector<Jog> jogs(stations.size());
+    // 以下命令作用于当前工位, n <序号> 切换
+    std::size_t current_index = 0;
+    station::Station* current = stations.front().get();
+    int calibration_stage = 0;
     while (true)
     {
         char command;
         float x, y;
+        auto& [m, p] = jogs[current_index];
         std::cin >> command;
-        if (is_playing)
+        // 下棋时也可以查询延迟, 指标和记录时间线
+        if (command == 'l')
+        {
+            logger.info("HID latency:\n{}", hid::latency_summary());
+        }
+        else if (command == 'm')
+        {
+            logger.info("Metrics:\n{}", metrics::summary());
+        }
+        else if (command == 'd')
+        {
+            auto path = std::format("hid-latency-{}.txt", std::time(nullptr));
+            if (hid::dump_latency(path))
+            {
+                logger.info("HID latency histograms written to {}.", path);
+            }
+        }
+        else if (command == 't')
+        {
+            if (tracing::enabled())
+            {
+                tracing::stop();
+            }
+            else
+            {
+                tracing::start(std::format("trace-{}.json", std::time(nullptr)));
+            }
+        }
+        else if (command == 'n')
+        {
+            std::size_t index;
+            std::cin >> index;
+            if (index < stations.size())
+            {
+                current_index = index;
+                current = stations[index].get();
+                calibration_stage = 0;
+                logger.info("Station {} selected.", current->settings.name);
+            }
+            else
+            {
+                logger.error("There are only {} stations.", stations.size());
+            }
+        }
+        else if (command == 'q')
+        {
+            break;
+        }
+        else if (current->is_playing())
         {
             if (command == 's')
             {
-                is_playing = false;
-                hid::interrupt_key_wait();
-                player.join();
+                current->stop();
             }
         }
         else if (command == 'g')
         {
             std::cin >> x >> y;
-            hid::send({x, y});
+            current->device.send({x, y});
             p = {x, y};
-            hid::wait_for_action_done();
+            current->device.wait_for_action_done();
         }
         else if (command == 'x')
         {
             std::cin >> x;
             x = p.first + x;
             y = p.second;
-            hid::send({x, y});
+            current->device.send({x, y});
             p = {x, y};
-            hid::wait_for_action_done();
+            current->device.wait_for_action_done();
         }
         else if (command == 'y')
         {
             std::cin >> y;
             x = p.first;
             y = p.second + y;
-            hid::send({x, y});
+            current->device.send({x, y});
             p = {x, y};
-            hid::wait_for_action_done();
+            current->device.wait_for_action_done();
         }
         else if (command == 'p')
         {
-            hid::send(hid::PUMP);
-            hid::wait_for_action_done();
+            current->device.send(hid::PUMP);
+            current->device.wait_for_action_done();
         }
         else if (command == 'z')
         {
             std::cin >> x;
-            hid::send({x});
-            hid::wait_for_action_done();
+            current->device.send({x});
+            current->device.wait_for_action_done();
         }
         else if (command == 'o')
         {
-            tmp = p;
             std::cin >> x >> y;
-            m.push_back({tmp, {x, y}});
-            logger.trace("stm point: {}, {}, grid: {}, {}", tmp.first, tmp.second, x, y);
+            m.push_back({p, {x, y}});
+            LOG_TRACE(logger, "stm point: {}, {}, grid: {}, {}", p.first, p.second, x, y);
         }
         else if (command == 'k')
         {
+            if (m.size() < 2)
+            {
+                logger.error("Record two points with o before computing the coefs.");
+                continue;
+            }
             kx = (m[1].first.first - m[0].first.first) / (m[1].second.first - m[0].second.first);
             ky = (m[1].first.second - m[0].first.second) / (m[1].second.second - m[0].second.second);
             bx = m[0].first.first - kx * m[0].second.first;
-            by = m[0].first.second - kx * m[0].second.second;
-            logger.trace("Coefs: {}, {}, {}, {}", kx, bx, ky, by);
-            std::ofstream tmp_file(tmp_file_name);
-            tmp_file << kx << bx << ky << by;
+            by = m[0].first.second - ky * m[0].second.second;
+            LOG_TRACE(logger, "Coefs: {}, {}, {}, {}", kx, bx, ky, by);
+            current->set_calibration(kx, bx, ky, by);
+            std::ofstream tmp_file(current->settings.coefs_file);
+            tmp_file << kx << ' ' << bx << ' ' << ky << ' ' << by;
             tmp_file.close();
+            // 下次标定重新记点
+            m.clear();
         }
         else if (command == 'r')
         {
-            std::ifstream tmp_file(tmp_file_name);
-            tmp_file >> kx >> bx >> ky >> by;
-            logger.trace("Coefs: {}, {}, {}, {}", kx, bx, ky, by);
+            std::ifstream tmp_file(current->settings.coefs_file);
+            if (!(tmp_file >> kx >> bx >> ky >> by))
+            {
+                logger.error("Cannot read coefs from {}.", current->settings.coefs_file);
+                continue;
+            }
+            LOG_TRACE(logger, "Coefs: {}, {}, {}, {}", kx, bx, ky, by);
+            current->set_calibration(kx, bx, ky, by);
             tmp_file.close();
         }
         else if (command == 'h')
         {
-            if (!hid::init())
+            if (!current->device.init())
             {
                 logger.error("Reconnect failed.");
-                hid::exit();
+                current->device.exit();
+            }
+        }
+        else if (command == 'v')
+        {
+            if (current->camera.is_recording())
+            {
+                current->camera.stop_recording();
+            }
+            else
+            {
+                current->camera.start_recording(std::format("record-{}.grec", std::time(nullptr)));
             }
         }
+        else if (command == 'c')
+        {
+            calibration_stage = current->camera.calibrate(calibration_stage);
+        }
         else if (command == 'e')
         {
-            is_playing = true;
-            player = std::thread(func);
+            current->start();
         }
-        else if (command == 'q')
+        else if (command == 'i')
         {
-            break;
+            current->restart();
+        }
+        else if (command == 'f')
+        {
+            current->end_game();
         }
     }
-    opencv::exit();
-    hid::exit();
+    for (auto& station: stations)
+    {
+        station->stop();
+    }
+    tracing::stop();
+    metrics::stop_export();
+    gomokuai::pool_stop();
+    for (auto& station: stations)
+    {
+        station->exit();
+    }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include "metrics.hpp"
+
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+
+#include "logger.hpp"
+
+namespace metrics
+{
+    static Logger logger("Metrics");
+
+    // 指标多在其他文件的静态初始化中注册, 用函数内静态变量避免初始化顺序问题
+    std::mutex& registry_lock()
+    {
+        static std::mutex lock;
+        return lock;
+    }
+
+    std::vector<std::unique_ptr<Metric>>& registry()
+    {
+        static std::vector<std::unique_ptr<Metric>> metrics;
+        return metrics;
+    }
+
+    void write_header(std::string& out, const Metric& metric, const char* type)
+    {
+        out.append(format("# HELP {} {}\n# TYPE {} {}\n", metric.name, metric.help, metric.name, type));
+    }
+
+    void Counter::write_prometheus(std::string& out) const
+    {
+        write_header(out, *this, "counter");
+        out.append(format("{} {}\n", name, get()));
+    }
+
+    std::string Counter::summary() const
+    {
+        return format("{}: {}", name, get());
+    }
+
+    void Gauge::write_prometheus(std::string& out) const
+    {
+        write_header(out, *this, "gauge");
+        out.append(format("{} {}\n", name, get()));
+    }
+
+    std::string Gauge::summary() const
+    {
+        return format("{}: {}", name, get());
+    }
+
+    Histogram::Histogram(const std::string& name, const std::string& help, std::vector<double> bounds):
+        Metric(name, help),
+        bounds(std::move(bounds)),
+        buckets(new std::atomic<uint64_t>[this->bounds.size() + 1]{})
+    {
+    }
+
+    void Histogram::observe(double value)
+    {
+        std::size_t bucket = std::lower_bound(bounds.begin(), bounds.end(), value) - bounds.begin();
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    double Histogram::percentile(double p) const
+    {
+        double target = p * count();
+        uint64_t seen = 0;
+        for (std::size_t i = 0; i <= bounds.size(); i++)
+        {
+            uint64_t n = buckets[i].load(std::memory_order_relaxed);
+            if (n > 0 && seen + n >= target)
+            {
+                // 落在 +Inf 桶时只能给出最大的有限上界
+                if (i == bounds.size())
+                {
+                    return bounds.back();
+                }
+                double lower = i == 0 ? 0 : bounds[i - 1];
+                return lower + (bounds[i] - lower) * (target - seen) / n;
+            }
+            seen += n;
+        }
+        return 0;
+    }
+
+    void Histogram::write_prometheus(std::string& out) const
+    {
+        write_header(out, *this, "histogram");
+        uint64_t cumulative = 0;
+        for (std::size_t i = 0; i < bounds.size(); i++)
+        {
+            cumulative += buckets[i].load(std::memory_order_relaxed);
+            out.append(format("{}_bucket{{le=\"{}\"}} {}\n", name, bounds[i], cumulative));
+        }
+        cumulative += buckets[bounds.size()].load(std::memory_order_relaxed);
+        out.append(format("{}_bucket{{le=\"+Inf\"}} {}\n", name, cumulative));
+        out.append(format("{}_sum {}\n", name, sum.load(std::memory_order_relaxed)));
+        out.append(format("{}_count {}\n", name, cumulative));
+    }
+
+    std::string Histogram::summary() const
+    {
+        uint64_t n = count();
+        if (n == 0)
+        {
+            return format("{}: no samples", name);
+        }
+        // 时间以毫秒显示
+        double scale = name.ends_with("_seconds") ? 1000 : 1;
+        const char* unit = scale == 1 ? "" : " ms";
+        return format(
+            "{}: {} samples, mean {:.2f}{}, p50 {:.2f}{}, p95 {:.2f}{}, p99 {:.2f}{}",
+            name, n, sum.load(std::memory_order_relaxed) / n * scale, unit,
+            percentile(0.5) * scale, unit, percentile(0.95) * scale, unit, percentile(0.99) * scale, unit
+        );
+    }
+
+    std::vector<double> exponential_buckets(double start, double factor, int count)
+    {
+        std::vector<double> bounds;
+        for (int i = 0; i < count; i++, start *= factor)
+        {
+            bounds.push_back(start);
+        }
+        return bounds;
+    }
+
+    template<typename Metric_t, typename... Args_t>
+    Metric_t& find_or_add(const std::string& name, const std::string& help, Args_t&&... args)
+    {
+        auto guard = std::lock_guard(registry_lock());
+        for (auto& metric: registry())
+        {
+            if (metric->name == name)
+            {
+                if (auto existing = dynamic_cast<Metric_t*>(metric.get()))
+                {
+                    return *existing;
+                }
+                logger.error("Metric {} is registered with another type.", name);
+            }
+        }
+        registry().push_back(std::make_unique<Metric_t>(name, help, std::forward<Args_t>(args)...));
+        return static_cast<Metric_t&>(*registry().back());
+    }
+
+    Counter& counter(const std::string& name, const std::string& help)
+    {
+        return find_or_add<Counter>(name, help);
+    }
+
+    Gauge& gauge(const std::string& name, const std::string& help)
+    {
+        return find_or_add<Gauge>(name, help);
+    }
+
+    Histogram& histogram(const std::string& name, const std::string& help, const std::vector<double>& bounds)
+    {
+        return find_or_add<Histogram>(name, help, bounds);
+    }
+
+    std::string summary()
+    {
+        auto guard = std::lock_guard(registry_lock());
+        std::string text;
+        for (auto& metric: registry())
+        {
+            if (!text.empty())
+            {
+                text.push_back('\n');
+            }
+            text.append(metric->summary());
+        }
+        return text;
+    }
+
+    bool export_textfile(const std::string& path)
+    {
+        std::string text;
+        {
+            auto guard = std::lock_guard(registry_lock());
+            for (auto& metric: registry())
+            {
+                metric->write_prometheus(text);
+            }
+        }
+        std::string temp_path = path + ".tmp";
+        {
+            std::ofstream file(temp_path);
+            if (!file || !(file << text))
+            {
+                logger.error("Cannot write metrics to {}.", temp_path);
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(temp_path, path, error);
+        if (error)
+        {
+            logger.error("Cannot replace {}: {}", path, error.message());
+            return false;
+        }
+        return true;
+    }
+
+    std::mutex export_lock;
+    std::condition_variable export_cond;
+    bool export_stopping = false;
+    std::thread export_thread;
+
+    void start_export(const std::string& path)
+    {
+        stop_export();
+        export_stopping = false;
+        export_thread = std::thread([path]
+        {
+            auto lock = std::unique_lock(export_lock);
+            while (!export_cond.wait_for(lock, config::metrics_export_interval, []{ return export_stopping; }))
+            {
+                lock.unlock();
+                export_textfile(path);
+                lock.lock();
+            }
+            lock.unlock();
+            // 退出前再导出一次, 保留最后一段时间的数据
+            export_textfile(path);
+        });
+        logger.info("Exporting metrics to {} every {} s.", path, config::metrics_export_interval.count());
+    }
+
+    void stop_export()
+    {
+        if (!export_thread.joinable())
+        {
+            return;
+        }
+        {
+            auto guard = std::lock_guard(export_lock);
+            export_stopping = true;
+        }
+        export_cond.notify_all();
+        export_thread.join();
+    }
+}
\ No newline at end of file
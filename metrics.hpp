@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// 进程内的计数器, 仪表和固定分桶直方图, 记录只用原子操作, 可在任意线程中调用
+// 注册后的对象不会被销毁, 调用处可保存引用
+namespace metrics
+{
+    class Metric
+    {
+    public:
+        const std::string name;
+        const std::string help;
+
+        Metric(const std::string& name, const std::string& help): name(name), help(help) {}
+        virtual ~Metric() = default;
+
+        // Prometheus 文本格式
+        virtual void write_prometheus(std::string& out) const = 0;
+        virtual std::string summary() const = 0;
+    };
+
+    class Counter: public Metric
+    {
+        std::atomic<uint64_t> value{0};
+
+    public:
+        using Metric::Metric;
+
+        void add(uint64_t n = 1)
+        {
+            value.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        uint64_t get() const
+        {
+            return value.load(std::memory_order_relaxed);
+        }
+
+        void write_prometheus(std::string& out) const override;
+        std::string summary() const override;
+    };
+
+    class Gauge: public Metric
+    {
+        std::atomic<double> value{0};
+
+    public:
+        using Metric::Metric;
+
+        void set(double v)
+        {
+            value.store(v, std::memory_order_relaxed);
+        }
+
+        double get() const
+        {
+            return value.load(std::memory_order_relaxed);
+        }
+
+        void write_prometheus(std::string& out) const override;
+        std::string summary() const override;
+    };
+
+    class Histogram: public Metric
+    {
+        // 各桶的上界, 递增; 最后还有一个 +Inf 桶
+        const std::vector<double> bounds;
+        std::unique_ptr<std::atomic<uint64_t>[]> buckets;
+        std::atomic<uint64_t> total{0};
+        std::atomic<double> sum{0};
+
+    public:
+        Histogram(const std::string& name, const std::string& help, std::vector<double> bounds);
+
+        void observe(double value);
+
+        // 以秒为单位记录
+        void observe(std::chrono::steady_clock::duration duration)
+        {
+            observe(std::chrono::duration<double>(duration).count());
+        }
+
+        uint64_t count() const
+        {
+            return total.load(std::memory_order_relaxed);
+        }
+
+        // 在所在桶内线性插值, 与 Prometheus 的 histogram_quantile 相同
+        double percentile(double p) const;
+
+        void write_prometheus(std::string& out) const override;
+        std::string summary() const override;
+    };
+
+    // start, start * factor, ... 共 count 个上界
+    std::vector<double> exponential_buckets(double start, double factor, int count);
+
+    // 同名的指标只注册一次
+    Counter& counter(const std::string& name, const std::string& help);
+    Gauge& gauge(const std::string& name, const std::string& help);
+    Histogram& histogram(const std::string& name, const std::string& help, const std::vector<double>& bounds);
+
+    // 每个指标一行, 直方图给出 p50/p95/p99
+    std::string summary();
+
+    // 先写临时文件再改名, 采集方不会读到写了一半的文件
+    bool export_textfile(const std::string& path);
+
+    // 后台线程按 config::metrics_export_interval 定期导出
+    void start_export(const std::string& path);
+    void stop_export();
+}
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include "planner.hpp"
+
+#include <cmath>
+#include <limits>
+
+#include "../config.hpp"
+
+namespace motion
+{
+    Planner::Planner(const string& station_name, hid::Device& device):
+        logger(instance_name("Motion", station_name)),
+        device(device)
+    {
+        reset({0, 0});
+    }
+
+    void Planner::set_calibration(float kx, float bx, float ky, float by)
+    {
+        this->kx = kx;
+        this->bx = bx;
+        this->ky = ky;
+        this->by = by;
+    }
+
+    hid::Report Planner::to_arm(gomokuai::Coord_2D point) const
+    {
+        return {kx * point.row + bx, ky * point.col + by};
+    }
+
+    void Planner::reset(gomokuai::Coord_2D start)
+    {
+        for (int i = 0; i < tray_size; i++)
+        {
+            tray_stones[i] = config::stone_tray[i][2];
+        }
+        auto report = to_arm(start);
+        arm_x = report.data.xy_pos.x;
+        arm_y = report.data.xy_pos.y;
+        pump_on = false;
+    }
+
+    float Planner::arm_distance(gomokuai::Coord_2D a, gomokuai::Coord_2D b) const
+    {
+        auto p = to_arm(a), q = to_arm(b);
+        return std::hypot(p.data.xy_pos.x - q.data.xy_pos.x, p.data.xy_pos.y - q.data.xy_pos.y);
+    }
+
+    template<std::size_t N>
+    gomokuai::Coord_2D Planner::nearest(const int (&points)[N][2], gomokuai::Coord_2D likely) const
+    {
+        gomokuai::Coord_2D best;
+        float best_distance = std::numeric_limits<float>::max();
+        for (auto& point: points)
+        {
+            float distance = arm_distance({point[0], point[1]}, likely);
+            if (distance < best_distance)
+            {
+                best = {point[0], point[1]};
+                best_distance = distance;
+            }
+        }
+        return best;
+    }
+
+    gomokuai::Coord_2D Planner::choose_park(gomokuai::Coord_2D likely) const
+    {
+        return nearest(config::park_points, likely);
+    }
+
+    gomokuai::Coord_2D Planner::choose_hover(gomokuai::Coord_2D likely) const
+    {
+        return nearest(config::hover_points, likely);
+    }
+
+    // 选离 near 最近的料槽, need_stone 为 true 时要求有棋子, 否则要求有空位
+    int Planner::choose_slot(gomokuai::Coord_2D near, bool need_stone)
+    {
+        int best = -1;
+        float best_distance = std::numeric_limits<float>::max();
+        for (int i = 0; i < tray_size; i++)
+        {
+            bool unlimited = config::stone_tray[i][2] == 0;
+            bool usable = unlimited || (need_stone ? tray_stones[i] > 0 : tray_stones[i] < config::stone_tray[i][2]);
+            float distance = arm_distance({config::stone_tray[i][0], config::stone_tray[i][1]}, near);
+            if (usable && distance < best_distance)
+            {
+                best = i;
+                best_distance = distance;
+            }
+        }
+        if (best == -1)
+        {
+            logger.warn("No tray slot {}, using the first one.", need_stone ? "has stones left" : "has room");
+            best = 0;
+        }
+        tray_stones[best] += need_stone ? -1 : 1;
+        return best;
+    }
+
+    void Planner::add_move(Plan& plan, gomokuai::Coord_2D point)
+    {
+        auto report = to_arm(point);
+        float distance = std::hypot(report.data.xy_pos.x - arm_x, report.data.xy_pos.y - arm_y);
+        arm_x = report.data.xy_pos.x;
+        arm_y = report.data.xy_pos.y;
+        plan.commands.push_back(report);
+        plan.estimate += std::chrono::milliseconds((long long)(1000 * distance / config::arm_xy_speed)) + config::arm_settle_time;
+    }
+
+    void Planner::add_pump(Plan& plan)
+    {
+        pump_on = !pump_on;
+        plan.commands.push_back(hid::PUMP);
+        plan.estimate += config::arm_pump_time;
+    }
+
+    gomokuai::Coord_2D slot_point(int slot)
+    {
+        return {config::stone_tray[slot][0], config::stone_tray[slot][1]};
+    }
+
+    Plan Planner::plan_fetch(gomokuai::Coord_2D near, std::optional<gomokuai::Coord_2D> park)
+    {
+        Plan plan("fetch");
+        if (pump_on)
+        {
+            logger.warn("Fetching a stone while already holding one.");
+        }
+        add_move(plan, slot_point(choose_slot(near, true)));
+        add_pump(plan);
+        if (park)
+        {
+            add_move(plan, *park);
+        }
+        return plan;
+    }
+
+    Plan Planner::plan_place(gomokuai::Coord_2D target)
+    {
+        Plan plan("place");
+        add_move(plan, target);
+        add_pump(plan);
+        return plan;
+    }
+
+    Plan Planner::plan_park(gomokuai::Coord_2D point)
+    {
+        Plan plan("park");
+        add_move(plan, point);
+        return plan;
+    }
+
+    Plan Planner::plan_return(gomokuai::Coord_2D park)
+    {
+        Plan plan("return");
+        // 当前位置对应的棋盘坐标
+        gomokuai::Coord_2D here(std::lround((arm_x - bx) / kx), std::lround((arm_y - by) / ky));
+        add_move(plan, slot_point(choose_slot(here, false)));
+        add_pump(plan);
+        add_move(plan, park);
+        return plan;
+    }
+
+    Execution Planner::execute(Plan&& plan)
+    {
+        auto timing = std::make_shared<hid::PlanTiming>();
+        auto results = device.send_plan(plan.commands, timing);
+        return {std::move(plan), timing, std::move(results)};
+    }
+
+    bool Planner::finish(Execution& execution)
+    {
+        bool completed = true;
+        for (auto& result: execution.results)
+        {
+            completed &= result.get() == hid::COMMAND_DONE;
+        }
+        execution.results.clear();
+        if (!completed)
+        {
+            return false;
+        }
+        auto actual = std::chrono::duration_cast<std::chrono::milliseconds>(execution.timing->finished - execution.timing->started);
+        LOG_TRACE(
+            logger, "Plan {}: {} commands, planned {} ms, actual {} ms.",
+            execution.plan.name, execution.plan.commands.size(), execution.plan.estimate.count(), actual.count()
+        );
+        return true;
+    }
+}
\ No newline at end of file
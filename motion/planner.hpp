@@ -0,0 +1,91 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+#include <future>
+#include <optional>
+
+#include "../logger.hpp"
+#include "../ai/gomokuai.hpp"
+#include "../hid/hid.hpp"
+#include "../config.hpp"
+
+namespace motion
+{
+    // 一串按顺序发给下位机的命令, 以及按运动模型估计的总耗时
+    struct Plan
+    {
+        explicit Plan(const char* name): name(name) {}
+
+        const char* name;
+        std::vector<hid::Report> commands;
+        std::chrono::milliseconds estimate{0};
+    };
+
+    // 已提交的规划, 由下位机记录实际执行时间以与估计比较, 排队等待前面规划的时间不计入
+    struct Execution
+    {
+        Plan plan;
+        std::shared_ptr<hid::PlanTiming> timing;
+        std::vector<std::future<hid::COMMAND_RESULT>> results;
+    };
+
+    // 一个工位的机械臂: 坐标标定, 料槽余量, 以及按已提交的规划推算的位置
+    class Planner
+    {
+    public:
+        Planner(const string& station_name, hid::Device& device);
+
+        // 棋盘坐标到机械臂坐标的线性映射
+        void set_calibration(float kx, float bx, float ky, float by);
+
+        hid::Report to_arm(gomokuai::Coord_2D point) const;
+
+        // 料槽装满, 机械臂位置重置为 start
+        void reset(gomokuai::Coord_2D start);
+
+        // 停靠点候选中离 likely 最近的一个
+        gomokuai::Coord_2D choose_park(gomokuai::Coord_2D likely) const;
+
+        // 悬停点候选中离 likely 最近的一个
+        gomokuai::Coord_2D choose_hover(gomokuai::Coord_2D likely) const;
+
+        // 从离 near 最近且有棋子的料槽吸起一颗棋子, 然后停在 park; park 为空时停在料槽, 之后直接去落子点
+        Plan plan_fetch(gomokuai::Coord_2D near, std::optional<gomokuai::Coord_2D> park = {});
+
+        // 把吸着的棋子放到 target
+        Plan plan_place(gomokuai::Coord_2D target);
+
+        // 移动到 point 停下
+        Plan plan_park(gomokuai::Coord_2D point);
+
+        // 把吸着的棋子放回离当前位置最近且有空位的料槽, 然后停在 park
+        Plan plan_return(gomokuai::Coord_2D park);
+
+        Execution execute(Plan&& plan);
+
+        // 等待全部命令完成并记录估计与实际耗时, 有命令未完成时返回 false
+        bool finish(Execution& execution);
+
+    private:
+        static constexpr int tray_size = std::size(config::stone_tray);
+
+        Logger logger;
+        hid::Device& device;
+
+        float kx = 1, bx = 0, ky = 1, by = 0;
+
+        // 规划时假定之前的规划都已按顺序执行, 以此推算机械臂位置
+        float arm_x = 0, arm_y = 0;
+        bool pump_on = false;
+
+        int tray_stones[tray_size];
+
+        float arm_distance(gomokuai::Coord_2D a, gomokuai::Coord_2D b) const;
+        template<std::size_t N>
+        gomokuai::Coord_2D nearest(const int (&points)[N][2], gomokuai::Coord_2D likely) const;
+        int choose_slot(gomokuai::Coord_2D near, bool need_stone);
+        void add_move(Plan& plan, gomokuai::Coord_2D point);
+        void add_pump(Plan& plan);
+    };
+}
\ No newline at end of file
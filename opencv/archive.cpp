@@ -0,0 +1,230 @@
+#include "opencv.hpp"
+#include "vision.hpp"
+
+#include <ctime>
+#include <cmath>
+#include <regex>
+
+#include "../config.hpp"
+
+namespace fs = std::filesystem;
+
+namespace opencv
+{
+    struct ArchiveSlot
+    {
+        // 原始帧的副本, 由后台线程缩小到 img
+        cv::Mat frame;
+        cv::Mat img;
+        Detection detection;
+        bool has_grid;
+        cv::Vec2f origin, dx, dy;
+        gomokuai::Board board;
+        int move_number;
+        gomokuai::Coord_2D move;
+        std::time_t time;
+    };
+
+    Archive::Archive(const Logger& logger, const string& directory):
+        logger(logger),
+        directory(directory),
+        slots(new ArchiveSlot[depth])
+    {
+    }
+
+    Archive::~Archive()
+    {
+        stop();
+    }
+
+    void Archive::add_archived_file(const fs::path& path)
+    {
+        std::error_code ec;
+        auto size = fs::file_size(path, ec);
+        if (ec)
+        {
+            return;
+        }
+        archived_files.emplace_back(path, size);
+        archived_bytes += size;
+    }
+
+    void Archive::enforce_disk_budget()
+    {
+        while (archived_bytes > (std::uintmax_t)config::archive_disk_budget && !archived_files.empty())
+        {
+            auto& [path, size] = archived_files.front();
+            std::error_code ec;
+            fs::remove(path, ec);
+            archived_bytes -= size;
+            archived_files.pop_front();
+        }
+    }
+
+    // 只管理自己写的存档文件 (YYYYmmdd-HHMMSS-moveNNN.jpg/.txt), 目录中的其他文件不计入预算也不删除
+    bool is_archive_file(const fs::path& path)
+    {
+        static const std::regex pattern(R"(\d{8}-\d{6}-move\d{3,}\.(jpg|txt))");
+        return std::regex_match(path.filename().string(), pattern);
+    }
+
+    void Archive::scan_directory()
+    {
+        std::error_code ec;
+        fs::create_directories(directory, ec);
+        std::vector<fs::path> paths;
+        for (auto& entry: fs::directory_iterator(directory, ec))
+        {
+            if (entry.is_regular_file() && is_archive_file(entry.path()))
+            {
+                paths.push_back(entry.path());
+            }
+        }
+        // 文件名以时间开头, 按名字排序即按时间排序
+        std::sort(paths.begin(), paths.end());
+        for (auto& path: paths)
+        {
+            add_archived_file(path);
+        }
+        enforce_disk_budget();
+    }
+
+    void draw_board(cv::Mat& img, const ArchiveSlot& slot, float scale)
+    {
+        int radius = std::max(2.f, 0.2f * scale * std::sqrt(slot.dx.dot(slot.dx)));
+        for (int i = 0; i < (int)slot.board.size(); i++)
+        {
+            if (slot.board[i] == gomokuai::EMPTY)
+            {
+                continue;
+            }
+            cv::Vec2f pos = slot.origin + (i / config::board_size) * slot.dx + (i % config::board_size) * slot.dy;
+            cv::circle(img, cv::Point(pos * scale), radius, slot.board[i] == gomokuai::BLACK ? BLACK : WHITE, cv::FILLED, cv::LINE_AA);
+            cv::circle(img, cv::Point(pos * scale), radius, cv::Scalar(0, 0, 255), 1, cv::LINE_AA);
+        }
+        cv::Vec2f target = slot.origin + slot.move.row * slot.dx + slot.move.col * slot.dy;
+        cv::circle(img, cv::Point(target * scale), 2 * radius, cv::Scalar(0, 0, 255), std::max(1, radius / 3), cv::LINE_AA);
+    }
+
+    void Archive::write(ArchiveSlot& slot, std::vector<uchar>& buf)
+    {
+        cv::resize(slot.frame, slot.img, cv::Size(), config::archive_scale, config::archive_scale, cv::INTER_AREA);
+        slot.detection.draw(slot.img, config::archive_scale);
+        if (slot.has_grid)
+        {
+            draw_board(slot.img, slot, config::archive_scale);
+        }
+
+        // 每个工位各有一个存档线程, 不能用共享静态缓冲区的 std::localtime
+        std::tm local_time;
+        localtime_r(&slot.time, &local_time);
+        char time_str[32];
+        std::strftime(time_str, sizeof(time_str), "%Y%m%d-%H%M%S", &local_time);
+        fs::path stem = directory / format("{}-move{:03}", time_str, slot.move_number);
+
+        cv::imencode(".jpg", slot.img, buf, {cv::IMWRITE_JPEG_QUALITY, config::archive_jpeg_quality});
+        auto image_path = fs::path(stem).replace_extension(".jpg");
+        std::ofstream image_file(image_path, std::ios::binary);
+        image_file.write((const char*)buf.data(), buf.size());
+        image_file.close();
+
+        auto board_path = fs::path(stem).replace_extension(".txt");
+        std::ofstream board_file(board_path);
+        board_file << format("move {}: {}, {}\n", slot.move_number, slot.move.row, slot.move.col);
+        for (int row = 0; row < config::board_size; row++)
+        {
+            for (int col = 0; col < config::board_size; col++)
+            {
+                board_file << ".XO"[slot.board[row * config::board_size + col]];
+            }
+            board_file << '\n';
+        }
+        board_file.close();
+
+        add_archived_file(image_path);
+        add_archived_file(board_path);
+        enforce_disk_budget();
+    }
+
+    void Archive::run()
+    {
+        std::vector<uchar> buf;
+        scan_directory();
+        while (true)
+        {
+            ArchiveSlot* slot;
+            pending.wait_pop(slot);
+            if (slot == nullptr)
+            {
+                return;
+            }
+            write(*slot, buf);
+            free_slots.push(slot);
+        }
+    }
+
+    void Archive::start()
+    {
+        if (!config::archive_enabled || is_archiving)
+        {
+            return;
+        }
+        for (std::size_t i = 0; i < depth; i++)
+        {
+            free_slots.push(&slots[i]);
+        }
+        dropped = 0;
+        thread = std::thread(&Archive::run, this);
+        is_archiving = true;
+    }
+
+    void Archive::stop()
+    {
+        if (!is_archiving)
+        {
+            return;
+        }
+        pending.push(nullptr);
+        thread.join();
+        ArchiveSlot* slot;
+        while (free_slots.pop(slot));
+        is_archiving = false;
+        if (dropped > 0)
+        {
+            logger.warn("{} archived frames were dropped.", dropped);
+        }
+    }
+
+    void Archive::move(const Frame& frame, const IncrementalReference& reference, const gomokuai::Board& board, int move_number, gomokuai::Coord_2D move)
+    {
+        ArchiveSlot* slot;
+        if (!is_archiving)
+        {
+            return;
+        }
+        if (!free_slots.pop(slot))
+        {
+            dropped++;
+            return;
+        }
+        // 只复制, 缩小留给后台线程; 帧大小不变时复用上次的缓冲区
+        frame.img.copyTo(slot->frame);
+        slot->detection.assign(frame);
+        slot->has_grid = frame.valid;
+        if (frame.valid)
+        {
+            slot->origin = frame.origin;
+            slot->dx = frame.dx;
+            slot->dy = frame.dy;
+        }
+        else
+        {
+            slot->has_grid = reference.grid(slot->origin, slot->dx, slot->dy);
+        }
+        slot->board = board;
+        slot->move_number = move_number;
+        slot->move = move;
+        slot->time = std::time(nullptr);
+        pending.push(slot);
+    }
+}
\ No newline at end of file
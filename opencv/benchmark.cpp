@@ -0,0 +1,96 @@
+#include "opencv.hpp"
+#include "vision.hpp"
+
+#include <cmath>
+
+#include "../config.hpp"
+
+namespace opencv
+{
+    // 识别参数中以像素计的量按分辨率缩放; HOUGH_GRADIENT 的累加值与圆周长成正比, 也一起缩放
+    void scale_hough(HoughParams& hough, float resolution_scale)
+    {
+        hough.min_dist *= resolution_scale;
+        hough.param2 = std::max(1.0, hough.param2 * resolution_scale);
+        hough.min_radius = std::lround(hough.min_radius * resolution_scale);
+        hough.max_radius = std::lround(hough.max_radius * resolution_scale);
+    }
+
+    void vision_benchmark(int frame_count, uint64_t seed, const string& profile, float resolution_scale)
+    {
+        cv::RNG rng(seed);
+        Frame frame;
+        VisionParams params;
+        if (load_vision_params(profile, params))
+        {
+            logger.info("Vision profile loaded from {}.", profile);
+        }
+        else
+        {
+            logger.warn("No vision profile at {}, using default parameters.", profile);
+        }
+        scale_hough(params.anchor_hough, resolution_scale);
+        scale_hough(params.stone_hough, resolution_scale);
+        gomokuai::Board truth;
+        std::vector<double> stage_ms[5];
+        const char* stage_names[5] = {"preprocess", "anchors", "stones", "assemble", "total"};
+        int invalid = 0, correct = 0;
+        long cell_errors = 0;
+
+        auto resolution = synthetic_frame_size(resolution_scale);
+        logger.info(
+            "Benchmarking recognition on {} synthetic {}x{} frames, seed {}.",
+            frame_count, resolution.width, resolution.height, seed
+        );
+        frame.allocate(resolution);
+        for (int i = 0; i < frame_count; i++)
+        {
+            generate_synthetic_frame(rng, frame.img, truth, resolution_scale);
+
+            auto begin = std::chrono::steady_clock::now();
+            preprocess(frame, params);
+            frame.stamp(PREPROCESSED);
+            detect_anchors(frame, params);
+            frame.stamp(ANCHORS_DETECTED);
+            detect_stones(frame, params);
+            frame.stamp(STONES_DETECTED);
+            assemble_board(frame);
+            frame.stamp(ASSEMBLED);
+
+            auto ms = [](auto duration){ return std::chrono::duration<double, std::milli>(duration).count(); };
+            stage_ms[0].push_back(ms(frame.timestamps[PREPROCESSED] - begin));
+            stage_ms[1].push_back(ms(frame.timestamps[ANCHORS_DETECTED] - frame.timestamps[PREPROCESSED]));
+            stage_ms[2].push_back(ms(frame.timestamps[STONES_DETECTED] - frame.timestamps[ANCHORS_DETECTED]));
+            stage_ms[3].push_back(ms(frame.timestamps[ASSEMBLED] - frame.timestamps[STONES_DETECTED]));
+            stage_ms[4].push_back(ms(frame.timestamps[ASSEMBLED] - begin));
+
+            if (!frame.valid)
+            {
+                invalid++;
+                continue;
+            }
+            int errors = 0;
+            for (int j = 0; j < (int)truth.size(); j++)
+            {
+                errors += frame.board[j] != truth[j];
+            }
+            cell_errors += errors;
+            correct += errors == 0;
+        }
+
+        if (int count = frame.check_buffers())
+        {
+            logger.warn("{} buffers were reallocated during the benchmark.", count);
+        }
+        for (int i = 0; i < 5; i++)
+        {
+            logger.info("{:>10}: {}", stage_names[i], summarise(stage_ms[i]));
+        }
+        int located = frame_count - invalid;
+        logger.info(
+            "Frames: {} generated, {} without anchors, {} fully correct, cell error rate {:.4f}% over located frames.",
+            frame_count, invalid, correct,
+            located == 0 ? 0.0 : 100.0 * cell_errors / ((double)located * config::board_size * config::board_size)
+        );
+    }
+}
\ No newline at end of file
@@ -0,0 +1,304 @@
+#include "opencv.hpp"
+#include "vision.hpp"
+
+#include <fstream>
+
+#include "../config.hpp"
+
+namespace opencv
+{
+    bool load_vision_params(const string& path, VisionParams& params)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            return false;
+        }
+        VisionParams loaded;
+        auto read_bytes = [&](uchar* values, int count)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                int value;
+                file >> value;
+                values[i] = std::clamp(value, 0, 255);
+            }
+        };
+        auto read_hough = [&](HoughParams& hough)
+        {
+            file >> hough.min_dist >> hough.param1 >> hough.param2 >> hough.min_radius >> hough.max_radius;
+        };
+        string key;
+        while (file >> key)
+        {
+            if (key == "anchor_low") read_bytes(loaded.colour.anchor_low, 3);
+            else if (key == "anchor_high") read_bytes(loaded.colour.anchor_high, 3);
+            else if (key == "main_anchor_low") read_bytes(loaded.colour.main_anchor_low, 3);
+            else if (key == "main_anchor_high") read_bytes(loaded.colour.main_anchor_high, 3);
+            else if (key == "black_max_value") read_bytes(&loaded.colour.black_max_value, 1);
+            else if (key == "white_min_value") read_bytes(&loaded.colour.white_min_value, 1);
+            else if (key == "white_max_saturation") read_bytes(&loaded.colour.white_max_saturation, 1);
+            else if (key == "anchor_hough") read_hough(loaded.anchor_hough);
+            else if (key == "stone_hough") read_hough(loaded.stone_hough);
+            else if (key == "stone_fill_ratio") file >> loaded.stone_fill_ratio;
+            else
+            {
+                logger.warn("Unknown key {} in vision profile {}.", key, path);
+                std::getline(file, key);
+            }
+            if (!file)
+            {
+                logger.error("Malformed vision profile {}.", path);
+                return false;
+            }
+        }
+        params = loaded;
+        return true;
+    }
+
+    bool save_vision_params(const string& path, const VisionParams& params)
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            logger.error("Cannot write vision profile {}.", path);
+            return false;
+        }
+        auto& c = params.colour;
+        auto write_bytes = [&](const char* key, const uchar* values)
+        {
+            file << format("{} {} {} {}\n", key, values[0], values[1], values[2]);
+        };
+        auto write_hough = [&](const char* key, const HoughParams& h)
+        {
+            file << format("{} {} {} {} {} {}\n", key, h.min_dist, h.param1, h.param2, h.min_radius, h.max_radius);
+        };
+        write_bytes("anchor_low", c.anchor_low);
+        write_bytes("anchor_high", c.anchor_high);
+        write_bytes("main_anchor_low", c.main_anchor_low);
+        write_bytes("main_anchor_high", c.main_anchor_high);
+        file << format("black_max_value {}\n", c.black_max_value);
+        file << format("white_min_value {}\n", c.white_min_value);
+        file << format("white_max_saturation {}\n", c.white_max_saturation);
+        write_hough("anchor_hough", params.anchor_hough);
+        write_hough("stone_hough", params.stone_hough);
+        file << format("stone_fill_ratio {}\n", params.stone_fill_ratio);
+        return (bool)file;
+    }
+
+    // 标定布局, 坐标与 AI 输出的落子点相同
+    const gomokuai::Coord_2D calibration_black[] = {{2, 3}, {5, 5}, {8, 7}};
+    const gomokuai::Coord_2D calibration_white[] = {{2, 7}, {8, 3}, {5, 8}};
+
+    bool Camera::capture_samples(const gomokuai::Board& truth)
+    {
+        pipeline.resume(false);
+        for (int i = 0; i < config::calibration_frames; i++)
+        {
+            Frame* frame = pipeline.next();
+            // 录制文件读完或流水线被中断, 之后不会再有帧
+            if (frame->end_of_source)
+            {
+                pipeline.pause();
+                pipeline.release(frame);
+                logger.error("The frame source ended after {} of {} calibration frames.", i, config::calibration_frames);
+                return false;
+            }
+            calibration_samples.push_back({frame->img.clone(), truth});
+            pipeline.release(frame);
+        }
+        pipeline.pause();
+        return true;
+    }
+
+    struct Evaluation
+    {
+        int correct = 0;
+        // 真实棋子处与其余位置的掩膜覆盖率之差的最小值, 越大越不容易误判
+        double margin = -1;
+
+        // 正确帧数优先, 裕度只在正确帧数相同时起作用
+        double score() const
+        {
+            return correct + 0.5 * margin;
+        }
+    };
+
+    Evaluation evaluate(Frame& scratch, const std::vector<CalibrationSample>& samples, const VisionParams& params)
+    {
+        Evaluation result;
+        double on_black = 1, off_black = 0, on_white = 1, off_white = 0;
+        bool has_valid = false;
+        for (auto& sample: samples)
+        {
+            sample.img.copyTo(scratch.img);
+            preprocess(scratch, params);
+            detect_anchors(scratch, params);
+            detect_stones(scratch, params);
+            assemble_board(scratch);
+            if (!scratch.valid)
+            {
+                continue;
+            }
+            has_valid = true;
+            result.correct += scratch.board == sample.truth;
+            for (int i = 0; i < (int)sample.truth.size(); i++)
+            {
+                cv::Rect rect;
+                if (!cell_patch(scratch.origin, scratch.dx, scratch.dy, i / config::board_size, i % config::board_size, scratch.img.size(), rect))
+                {
+                    continue;
+                }
+                double black = (double)cv::countNonZero(scratch.mask_black(rect)) / rect.area();
+                double white = (double)cv::countNonZero(scratch.mask_white(rect)) / rect.area();
+                if (sample.truth[i] == gomokuai::BLACK)
+                {
+                    on_black = std::min(on_black, black);
+                }
+                else
+                {
+                    off_black = std::max(off_black, black);
+                }
+                if (sample.truth[i] == gomokuai::WHITE)
+                {
+                    on_white = std::min(on_white, white);
+                }
+                else
+                {
+                    off_white = std::max(off_white, white);
+                }
+            }
+        }
+        if (has_valid)
+        {
+            result.margin = std::min(on_black - off_black, on_white - off_white);
+        }
+        return result;
+    }
+
+    struct Knob
+    {
+        const char* name;
+        void (*apply)(VisionParams&, int);
+        int from, to, step;
+    };
+
+    const Knob knobs[] = {
+        {"black_max_value", [](VisionParams& p, int v){ p.colour.black_max_value = v; }, 50, 140, 10},
+        {"white_min_value", [](VisionParams& p, int v){ p.colour.white_min_value = v; }, 140, 230, 10},
+        {"white_max_saturation", [](VisionParams& p, int v){ p.colour.white_max_saturation = v; }, 20, 110, 10},
+        {"anchor_low_blue", [](VisionParams& p, int v){ p.colour.anchor_low[0] = p.colour.main_anchor_low[0] = v; }, 110, 210, 10},
+        {"anchor_low_green", [](VisionParams& p, int v){ p.colour.anchor_low[1] = v; }, 60, 140, 10},
+        {"main_anchor_low_green", [](VisionParams& p, int v){ p.colour.main_anchor_low[1] = v; }, 130, 200, 10},
+        // 霍夫圆检测: 边缘阈值, 累加器阈值和半径范围; 最小与最大半径的范围不重叠
+        {"anchor_hough_param1", [](VisionParams& p, int v){ p.anchor_hough.param1 = v; }, 150, 450, 50},
+        {"anchor_hough_param2", [](VisionParams& p, int v){ p.anchor_hough.param2 = v; }, 8, 30, 2},
+        {"anchor_hough_min_radius", [](VisionParams& p, int v){ p.anchor_hough.min_radius = v; }, 40, 68, 4},
+        {"anchor_hough_max_radius", [](VisionParams& p, int v){ p.anchor_hough.max_radius = v; }, 72, 108, 4},
+        {"stone_hough_param1", [](VisionParams& p, int v){ p.stone_hough.param1 = v; }, 30, 150, 20},
+        {"stone_hough_param2", [](VisionParams& p, int v){ p.stone_hough.param2 = v; }, 10, 40, 5},
+        {"stone_hough_min_radius", [](VisionParams& p, int v){ p.stone_hough.min_radius = v; }, 30, 58, 4},
+        {"stone_hough_max_radius", [](VisionParams& p, int v){ p.stone_hough.max_radius = v; }, 62, 94, 4},
+    };
+
+    // 调用时流水线已暂停, 可以直接修改 params
+    void Camera::search_params()
+    {
+        Frame scratch;
+        scratch.allocate(calibration_samples.front().img.size());
+        VisionParams original = params;
+        VisionParams best = params;
+        Evaluation best_result = evaluate(scratch, calibration_samples, params);
+        logger.info(
+            "Current parameters: {} of {} frames correct, margin {:.3f}.",
+            best_result.correct, calibration_samples.size(), best_result.margin
+        );
+
+        // 坐标下降, 每次只调整一个参数
+        for (int pass = 0; pass < config::calibration_passes; pass++)
+        {
+            for (auto& knob: knobs)
+            {
+                for (int value = knob.from; value <= knob.to; value += knob.step)
+                {
+                    params = best;
+                    knob.apply(params, value);
+                    auto result = evaluate(scratch, calibration_samples, params);
+                    if (result.score() > best_result.score())
+                    {
+                        best = params;
+                        best_result = result;
+                        LOG_TRACE(
+                            logger, "{} = {}: {} frames correct, margin {:.3f}.",
+                            knob.name, value, result.correct, result.margin
+                        );
+                    }
+                }
+            }
+        }
+
+        logger.info(
+            "Calibrated parameters: {} of {} frames correct, margin {:.3f}.",
+            best_result.correct, calibration_samples.size(), best_result.margin
+        );
+        if (best_result.correct < (int)calibration_samples.size())
+        {
+            logger.warn("Not every calibration frame is recognised, check the lighting and the stone layout.");
+        }
+        params = best;
+        if (!save_vision_params(options.vision_profile, best))
+        {
+            params = original;
+        }
+        else
+        {
+            logger.info("Vision profile saved to {}.", options.vision_profile);
+        }
+    }
+
+    int Camera::calibrate(int stage)
+    {
+        gomokuai::Board truth;
+        truth.fill(gomokuai::EMPTY);
+        if (stage == 0)
+        {
+            calibration_samples.clear();
+            if (!capture_samples(truth))
+            {
+                calibration_samples.clear();
+                logger.error("Calibration failed.");
+                return 0;
+            }
+            string layout;
+            for (auto& point: calibration_black)
+            {
+                layout.append(format("B({}, {}) ", point.row, point.col));
+            }
+            for (auto& point: calibration_white)
+            {
+                layout.append(format("W({}, {}) ", point.row, point.col));
+            }
+            logger.info("Captured the empty board. Place the calibration stones {}and calibrate again.", layout);
+            return 1;
+        }
+
+        for (auto& point: calibration_black)
+        {
+            truth[point.row * config::board_size + point.col] = gomokuai::BLACK;
+        }
+        for (auto& point: calibration_white)
+        {
+            truth[point.row * config::board_size + point.col] = gomokuai::WHITE;
+        }
+        if (!capture_samples(truth))
+        {
+            calibration_samples.clear();
+            logger.error("Calibration failed.");
+            return 0;
+        }
+        logger.info("Searching vision parameters over {} frames...", calibration_samples.size());
+        search_params();
+        calibration_samples.clear();
+        return 0;
+    }
+}
\ No newline at end of file
@@ -1,4 +1,9 @@
 #include "opencv.hpp"
+#include "vision.hpp"
+
+#include <cmath>
+
+#include "../config.hpp"
 
 namespace opencv
 {
@@ -9,13 +14,14 @@ namespace opencv
     const int A4_BOARD_SPACING = (A4_BOARD_WIDTH - 2 * A4_BOARD_PADDING) / 10;
 
     void draw_circle(
+        cv::Mat& target,
         int x, int y,
         const cv::Scalar& color = BLACK,
         int radius = (int)(0.35 * A4_BOARD_SPACING)
     )
     {
         cv::circle(
-            img,
+            target,
             cv::Point(
                 x * A4_BOARD_SPACING + A4_BOARD_PADDING,
                 (y + 2) * A4_BOARD_SPACING + A4_BOARD_PADDING
@@ -24,6 +30,15 @@ namespace opencv
         );
     }
 
+    void draw_circle(
+        int x, int y,
+        const cv::Scalar& color = BLACK,
+        int radius = (int)(0.35 * A4_BOARD_SPACING)
+    )
+    {
+        draw_circle(img, x, y, color, radius);
+    }
+
     bool can_click = false;
     gomokuai::Coord_2D click_point;
 
@@ -43,33 +58,40 @@ namespace opencv
         }
     }
 
-    void draw_A4_board()
+    void draw_A4_board(cv::Mat& target, const cv::Scalar& main_anchor_color, const cv::Scalar& anchor_color)
     {
-        img = cv::Mat(A4_BOARD_HEIGHT, A4_BOARD_WIDTH, CV_8UC3, cv::Scalar(0, 95, 160));
+        target.create(A4_BOARD_HEIGHT, A4_BOARD_WIDTH, CV_8UC3);
+        target.setTo(cv::Scalar(0, 95, 160));
         for (int i = 0; i < 11; i++)
         {
             cv::line(
-                img,
+                target,
                 cv::Point(A4_BOARD_SPACING * i + A4_BOARD_PADDING, 2 * A4_BOARD_SPACING + A4_BOARD_PADDING),
                 cv::Point(A4_BOARD_SPACING * i + A4_BOARD_PADDING, 12 * A4_BOARD_SPACING + A4_BOARD_PADDING),
                 BLACK, 5
             );
             cv::line(
-                img,
+                target,
                 cv::Point(A4_BOARD_PADDING, A4_BOARD_SPACING * (i + 2) + A4_BOARD_PADDING), 
                 cv::Point(10 * A4_BOARD_SPACING + A4_BOARD_PADDING, A4_BOARD_SPACING * (i + 2) + A4_BOARD_PADDING),
                 BLACK, 5
             );
         }
-        draw_circle(5, 5, BLACK, 15);
-        draw_circle(2, 2, BLACK, 15);
-        draw_circle(2, 8, BLACK, 15);
-        draw_circle(8, 2, BLACK, 15);
-        draw_circle(8, 8, BLACK, 15);
-        draw_circle(1, -1, cv::Scalar(255, 191, 0), 100);
-        draw_circle(9, -1, cv::Scalar(255, 63, 0), 100);
-        draw_circle(1, 11, cv::Scalar(255, 63, 0), 100);
-        draw_circle(9, 11, cv::Scalar(255, 63, 0), 100);
+        draw_circle(target, 5, 5, BLACK, 15);
+        draw_circle(target, 2, 2, BLACK, 15);
+        draw_circle(target, 2, 8, BLACK, 15);
+        draw_circle(target, 8, 2, BLACK, 15);
+        draw_circle(target, 8, 8, BLACK, 15);
+        draw_circle(target, 1, -1, main_anchor_color, 100);
+        draw_circle(target, 9, -1, anchor_color, 100);
+        draw_circle(target, 1, 11, anchor_color, 100);
+        draw_circle(target, 9, 11, anchor_color, 100);
+    }
+
+    void draw_A4_board()
+    {
+        img = cv::Mat();
+        draw_A4_board(img, cv::Scalar(255, 191, 0), cv::Scalar(255, 63, 0));
     }
 
     void test(gomokuai::PIECE_TYPE ai_type)
@@ -103,4 +125,103 @@ namespace opencv
             }
         }
     }
+
+    // 模拟相机拍到的颜色, 落在识别阈值之内
+    const cv::Scalar CAMERA_MAIN_ANCHOR(255, 191, 0);
+    const cv::Scalar CAMERA_ANCHOR(255, 127, 0);
+    const cv::Scalar CAMERA_BLACK(30, 30, 30);
+    const cv::Scalar CAMERA_WHITE(235, 235, 235);
+
+    // 原始分辨率下相机图像中棋子的半径约为 60 像素, 其他分辨率按比例缩放
+    const int SYNTHETIC_STONE_RADIUS = 85;
+    const cv::Size CAMERA_RESOLUTION(3000, 2000);
+
+    cv::Size synthetic_frame_size(float resolution_scale)
+    {
+        return cv::Size(std::lround(CAMERA_RESOLUTION.width * resolution_scale), std::lround(CAMERA_RESOLUTION.height * resolution_scale));
+    }
+
+    void random_position(cv::RNG& rng, gomokuai::Board& truth)
+    {
+        const int grid_count = config::board_size * config::board_size;
+        int cells[grid_count];
+        for (int i = 0; i < grid_count; i++)
+        {
+            cells[i] = i;
+        }
+        truth.fill(gomokuai::EMPTY);
+        // 黑先, 黑子数等于白子数或多一个
+        int moves = rng.uniform(0, grid_count / 3);
+        for (int i = 0; i < moves; i++)
+        {
+            std::swap(cells[i], cells[rng.uniform(i, grid_count)]);
+            truth[cells[i]] = i % 2 == 0 ? gomokuai::BLACK : gomokuai::WHITE;
+        }
+    }
+
+    void generate_synthetic_frame(cv::RNG& rng, cv::Mat& frame, gomokuai::Board& truth, float resolution_scale)
+    {
+        static cv::Mat board, noise;
+        random_position(rng, truth);
+        draw_A4_board(board, CAMERA_MAIN_ANCHOR, CAMERA_ANCHOR);
+        for (int row = 0; row < config::board_size; row++)
+        {
+            for (int col = 0; col < config::board_size; col++)
+            {
+                auto type = truth[row * config::board_size + col];
+                if (type != gomokuai::EMPTY)
+                {
+                    draw_circle(board, row, col, type == gomokuai::BLACK ? CAMERA_BLACK : CAMERA_WHITE, SYNTHETIC_STONE_RADIUS);
+                }
+            }
+        }
+
+        // 透视变换: 棋盘横放, 随机缩放, 旋转, 平移, 并扰动四个角; 缩放和位移都随分辨率缩放
+        // 棋子在棋盘图上绘制, 经变换后半径也随分辨率缩放
+        cv::Size resolution = synthetic_frame_size(resolution_scale);
+        float scale = rng.uniform(0.65f, 0.75f) * resolution_scale;
+        float angle = (float)CV_PI / 2 + rng.uniform(-0.07f, 0.07f);
+        cv::Point2f center(
+            resolution.width / 2 + rng.uniform(-300.f, 300.f) * resolution_scale,
+            resolution.height / 2 + rng.uniform(-100.f, 100.f) * resolution_scale
+        );
+        cv::Point2f src[4] = {
+            {0, 0}, {(float)A4_BOARD_WIDTH, 0},
+            {(float)A4_BOARD_WIDTH, (float)A4_BOARD_HEIGHT}, {0, (float)A4_BOARD_HEIGHT}
+        };
+        cv::Point2f dst[4];
+        for (int i = 0; i < 4; i++)
+        {
+            float x = (src[i].x - A4_BOARD_WIDTH / 2) * scale;
+            float y = (src[i].y - A4_BOARD_HEIGHT / 2) * scale;
+            dst[i].x = center.x + x * std::cos(angle) - y * std::sin(angle) + rng.uniform(-20.f, 20.f) * resolution_scale;
+            dst[i].y = center.y + x * std::sin(angle) + y * std::cos(angle) + rng.uniform(-20.f, 20.f) * resolution_scale;
+        }
+        int background = rng.uniform(80, 140);
+        cv::warpPerspective(
+            board, frame, cv::getPerspectiveTransform(src, dst), resolution,
+            cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar::all(background)
+        );
+
+        // 光照: 亮度沿图像线性变化 ±10%
+        float gx = rng.uniform(-0.1f, 0.1f) / frame.cols;
+        float gy = rng.uniform(-0.1f, 0.1f) / frame.rows;
+        for (int y = 0; y < frame.rows; y++)
+        {
+            uchar* p = frame.ptr<uchar>(y);
+            for (int x = 0; x < frame.cols; x++)
+            {
+                float gain = 1 + gx * (x - frame.cols / 2) + gy * (y - frame.rows / 2);
+                for (int c = 0; c < 3; c++, p++)
+                {
+                    *p = cv::saturate_cast<uchar>(*p * gain);
+                }
+            }
+        }
+
+        cv::GaussianBlur(frame, frame, cv::Size(0, 0), rng.uniform(0.5, 2.0));
+        noise.create(frame.size(), CV_16SC3);
+        cv::randn(noise, 0, rng.uniform(1.0, 6.0));
+        cv::add(frame, noise, frame, cv::noArray(), CV_8UC3);
+    }
 }
\ No newline at end of file
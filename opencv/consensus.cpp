@@ -0,0 +1,74 @@
+#include "vision.hpp"
+
+namespace opencv
+{
+    BoardConsensus::BoardConsensus(int window):
+        history(window)
+    {}
+
+    void BoardConsensus::reset()
+    {
+        next = 0;
+        count = 0;
+        for (auto& cell: votes)
+        {
+            cell.fill(0);
+        }
+    }
+
+    void BoardConsensus::add(const gomokuai::Board& board)
+    {
+        auto& slot = history[next];
+        if (count == (int)history.size())
+        {
+            for (int i = 0; i < (int)slot.size(); i++)
+            {
+                votes[i][slot[i]]--;
+            }
+        }
+        else
+        {
+            count++;
+        }
+        slot = board;
+        for (int i = 0; i < (int)slot.size(); i++)
+        {
+            votes[i][slot[i]]++;
+        }
+        next = (next + 1) % history.size();
+    }
+
+    bool BoardConsensus::decide(float threshold, gomokuai::Board& result, std::vector<gomokuai::Coord_2D>& ambiguous) const
+    {
+        ambiguous.clear();
+        if (count < (int)history.size())
+        {
+            return false;
+        }
+        for (int i = 0; i < (int)votes.size(); i++)
+        {
+            auto& cell = votes[i];
+            int best = std::max_element(cell.begin(), cell.end()) - cell.begin();
+            result[i] = (gomokuai::PIECE_TYPE)best;
+            if (cell[best] < threshold * count)
+            {
+                ambiguous.emplace_back(i / config::board_size, i % config::board_size);
+            }
+        }
+        return ambiguous.empty();
+    }
+
+    float BoardConsensus::min_confidence() const
+    {
+        if (count == 0)
+        {
+            return 0;
+        }
+        int min_votes = count;
+        for (auto& cell: votes)
+        {
+            min_votes = std::min(min_votes, *std::max_element(cell.begin(), cell.end()));
+        }
+        return (float)min_votes / count;
+    }
+}
\ No newline at end of file
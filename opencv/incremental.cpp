@@ -0,0 +1,127 @@
+#include "vision.hpp"
+
+#include "../config.hpp"
+
+namespace opencv
+{
+    // 棋子覆盖检查区域的比例超过该值才认为是新落下的棋子
+    const double STONE_COVERAGE = 0.7;
+
+    void IncrementalReference::set(const Frame& frame, const gomokuai::Board& board)
+    {
+        if (frame.valid)
+        {
+            origin = frame.origin;
+            dx = frame.dx;
+            dy = frame.dy;
+            geometry_known = true;
+        }
+        if (!geometry_known)
+        {
+            return;
+        }
+        frame.img.copyTo(reference_img);
+        stones = board;
+        reference_known = true;
+    }
+
+    void IncrementalReference::clear()
+    {
+        reference_known = false;
+        geometry_known = false;
+    }
+
+    void IncrementalReference::restore(const gomokuai::Board& board, cv::Vec2f origin, cv::Vec2f dx, cv::Vec2f dy)
+    {
+        this->origin = origin;
+        this->dx = dx;
+        this->dy = dy;
+        geometry_known = true;
+        reference_img.release();
+        stones = board;
+        reference_known = true;
+    }
+
+    bool IncrementalReference::grid(cv::Vec2f& origin, cv::Vec2f& dx, cv::Vec2f& dy) const
+    {
+        origin = this->origin;
+        dx = this->dx;
+        dy = this->dy;
+        return geometry_known;
+    }
+
+    gomokuai::PIECE_TYPE IncrementalReference::classify_patch(const cv::Mat& patch, const VisionParams& params)
+    {
+        segment(patch, params.colour, patch_anchor, patch_main_anchor, patch_grey, patch_black, patch_white);
+        double area = patch.rows * patch.cols;
+        if (cv::countNonZero(patch_black) > STONE_COVERAGE * area)
+        {
+            return gomokuai::BLACK;
+        }
+        if (cv::countNonZero(patch_white) > STONE_COVERAGE * area)
+        {
+            return gomokuai::WHITE;
+        }
+        return gomokuai::EMPTY;
+    }
+
+    bool IncrementalReference::detect_changes(const Frame& frame, const VisionParams& params, int new_black, int new_white, gomokuai::Board& board)
+    {
+        bool restored = reference_img.empty();
+        if (!reference_known || (!restored && frame.img.size() != reference_img.size()))
+        {
+            return false;
+        }
+        board = stones;
+        int black_found = 0, white_found = 0;
+        for (int row = 0; row < config::board_size; row++)
+        {
+            for (int col = 0; col < config::board_size; col++)
+            {
+                cv::Rect rect;
+                if (!cell_patch(origin, dx, dy, row, col, frame.img.size(), rect))
+                {
+                    return false;
+                }
+                auto& cell = board[row * config::board_size + col];
+                if (restored)
+                {
+                    // 已有的棋子以日志为准, 只看空位上是否有新棋子
+                    if (cell != gomokuai::EMPTY)
+                    {
+                        continue;
+                    }
+                    cell = classify_patch(frame.img(rect), params);
+                    if (cell == gomokuai::EMPTY)
+                    {
+                        continue;
+                    }
+                }
+                else
+                {
+                    double diff = cv::norm(frame.img(rect), reference_img(rect), cv::NORM_L1) / (rect.area() * 3);
+                    if (diff < config::incremental_change_threshold)
+                    {
+                        continue;
+                    }
+                    // 已有棋子的位置发生变化, 或变化处不是棋子
+                    if (cell != gomokuai::EMPTY)
+                    {
+                        return false;
+                    }
+                    cell = classify_patch(frame.img(rect), params);
+                    if (cell == gomokuai::EMPTY)
+                    {
+                        return false;
+                    }
+                }
+                (cell == gomokuai::BLACK ? black_found : white_found)++;
+                if (black_found > new_black || white_found > new_white)
+                {
+                    return false;
+                }
+            }
+        }
+        return black_found == new_black && white_found == new_white;
+    }
+}
\ No newline at end of file
@@ -1,33 +1,31 @@
 #include "opencv.hpp"
-
-#include <thread>
+#include "vision.hpp"
 
 #include "../config.hpp"
+#include "../tracing.hpp"
+#include "../metrics.hpp"
 
 namespace opencv
 {
     Logger logger("OpenCV");
 
-    cv::VideoCapture cap;
-
-    std::thread window_thread;
-    bool is_active = false;
-
     cv::Mat img;
-    std::mutex img_lock;
 
-    void show_img(cv::Mat im, bool do_wait_key = true)
+    Camera::Camera(const string& station_name, const Options& options):
+        logger(instance_name("OpenCV", station_name)),
+        options(options),
+        pipeline(logger, station_name, workspace, params, options.preview),
+        consensus(config::consensus_frames),
+        recorder(logger),
+        archive(logger, options.archive_directory)
+    {}
+
+    Camera::~Camera()
     {
-        img_lock.lock();
-        img = im;
-        img_lock.unlock();
-        if (do_wait_key)
-        {
-            cv::waitKey();
-        }
+        exit();
     }
 
-    bool try_open_video(int index)
+    bool Camera::try_open_video(int index)
     {
         logger.info("Trying to open video{}...", index);
         cap.open(index);
@@ -46,188 +44,272 @@ namespace opencv
             cap.release();
             return false;
         }
-        show_img(img, false);
+        workspace.allocate(img.size());
+        if (options.preview)
+        {
+            publish_preview(img);
+        }
         logger.info("Succeeded!");
-        logger.trace("Video{} resolution: {}, {}.", index, img.cols, img.rows);
+        LOG_TRACE(logger, "Video{} resolution: {}, {}.", index, img.cols, img.rows);
         return true;
     }
 
-    void window_thread_run()
+    bool Camera::init()
     {
-        cv::namedWindow(window_title, cv::WINDOW_NORMAL);
-        while (is_active)
+        if (options.preview)
+        {
+            preview_start();
+        }
+        FrameSource source;
+        if (!options.recording.empty())
+        {
+            source = recording_source(options.recording.c_str());
+            Frame first;
+            if (!source || !source(first))
+            {
+                return false;
+            }
+            workspace.allocate(first.img.size());
+            if (options.preview)
+            {
+                publish_preview(first.img);
+            }
+            // 第一帧只用于分配缓冲区, 仍要送入流水线
+            source = [source, img = first.img, index = first.source_index](Frame& frame) mutable
+            {
+                if (img.empty())
+                {
+                    return source(frame);
+                }
+                img.copyTo(frame.img);
+                img.release();
+                frame.source_index = index;
+                return true;
+            };
+        }
+        else
         {
-            img_lock.lock();
-            if (!img.size().empty())
+            if (!try_open_video(options.video_device_id))
             {
-                cv::imshow(window_title, img);
+                return false;
             }
-            img_lock.unlock();
-            cv::waitKey(10);
+            source = [this](Frame& frame){ return cap.read(frame.img); };
         }
-        cv::destroyAllWindows();
+        if (load_vision_params(options.vision_profile, params))
+        {
+            logger.info("Vision profile loaded from {}.", options.vision_profile);
+        }
+        else
+        {
+            logger.warn("No vision profile at {}, using default parameters.", options.vision_profile);
+        }
+        pipeline.start(source);
+        archive.start();
+        return true;
     }
 
-    bool init()
+    void Camera::exit()
     {
-        is_active = true;
-        window_thread = std::thread(window_thread_run);
-        return try_open_video(config::video_device_id);
+        recorder.stop();
+        pipeline.stop();
+        archive.stop();
+        if (options.preview)
+        {
+            preview_stop();
+        }
+        cap.release();
     }
 
-    void exit()
+    bool Camera::start_recording(const string& path)
     {
-        is_active = false;
-        window_thread.join();
-        cap.release();
+        return recorder.start(path);
     }
 
-    gomokuai::Coord_2D get_ai_step(int desired_count)
+    void Camera::stop_recording()
     {
-        while (true)
+        recorder.stop();
+    }
+
+    bool Camera::is_recording() const
+    {
+        return recorder.active();
+    }
+
+    void Camera::interrupt_recognition()
+    {
+        interrupted = true;
+        pipeline.interrupt();
+    }
+
+    void Camera::clear_interrupt()
+    {
+        interrupted = false;
+    }
+
+    bool Camera::grid(cv::Vec2f& origin, cv::Vec2f& dx, cv::Vec2f& dy) const
+    {
+        return reference.grid(origin, dx, dy);
+    }
+
+    void Camera::restore(const gomokuai::Board& board, cv::Vec2f origin, cv::Vec2f dx, cv::Vec2f dy)
+    {
+        reference.restore(board, origin, dx, dy);
+    }
+
+    string format_cells(const std::vector<gomokuai::Coord_2D>& cells)
+    {
+        string str;
+        for (auto& cell: cells)
         {
-            cv::Mat img, grey, blue;
-            cap.read(img);
-            // show_img(img, false);
-            // continue;
-
-            // 定位点
-            cv::inRange(img, cv::Scalar(159, 95, 0), cv::Scalar(255, 223, 127), blue);
-            cv::GaussianBlur(blue, blue, cv::Size(5, 5), 0);
-            // show_img(blue);
-            std::vector<cv::Vec3f> anchor_circles;
-            cv::HoughCircles(blue, anchor_circles, cv::HOUGH_GRADIENT, 1, 500, 300, 15, 60, 80);
-            
-            cv::inRange(img, cv::Scalar(159, 159, 0), cv::Scalar(255, 255, 127), blue);
-            cv::GaussianBlur(blue, blue, cv::Size(5, 5), 0);
-            // show_img(blue);
-            std::vector<cv::Vec3f> anchor_circle;
-            cv::HoughCircles(blue, anchor_circle, cv::HOUGH_GRADIENT, 1, 500, 300, 15, 60, 80);
-
-            // 识别黑白棋子
-            cv::cvtColor(img, grey, cv::COLOR_BGR2GRAY);
-            cv::GaussianBlur(grey, grey, cv::Size(5, 5), 0);
-            // show_img(grey);
-            std::vector<cv::Vec3f> circles;
-            cv::HoughCircles(grey, circles, cv::HOUGH_GRADIENT, 1, 100, 50, 20, 50, 70);
-
-            if (anchor_circle.size() != 1 || anchor_circles.size() != 4)
-            {
-                continue;
-            }
-            std::vector<std::pair<float, cv::Vec2f>> dists;
-            cv::Vec2f main_anchor(anchor_circle[0][0], anchor_circle[0][1]);
-            for (int i = 0; i < 4; i++)
-            {
-                cv::Vec2f anchor(anchor_circles[i][0], anchor_circles[i][1]);
-                dists.push_back({(main_anchor - anchor).dot(main_anchor - anchor), anchor});
-            }
-            std::sort(dists.begin(), dists.end(), [](const std::pair<float, cv::Vec2f>& x, const std::pair<float, cv::Vec2f>& y){ return x.first < y.first; });
-            auto dx = (dists[1].second - dists[0].second)/8;
-            auto dy = (dists[2].second - dists[0].second)/12;
-            auto Dx = dx * 10;
-            auto Dy = dy * 10;
-            auto origin = dists[0].second - dx + dy;
+            str.append(format("({}, {}) ", cell.row, cell.col));
+        }
+        return str;
+    }
 
-            cv::cvtColor(img, blue, cv::COLOR_BGR2HSV);
+    metrics::Counter& frames_processed = metrics::counter(
+        "gomoku_vision_frames_total", "Frames consumed while recognising the board"
+    );
+    metrics::Counter& frames_rejected = metrics::counter(
+        "gomoku_vision_frames_rejected_total", "Frames discarded as invalid or inconsistent with the expected stones"
+    );
+    metrics::Histogram& turn_frames = metrics::histogram(
+        "gomoku_vision_turn_frames", "Frames needed to recognise the board in one turn", metrics::exponential_buckets(1, 2, 10)
+    );
+    metrics::Histogram& turn_rejected_frames = metrics::histogram(
+        "gomoku_vision_turn_rejected_frames", "Frames rejected in one turn", metrics::exponential_buckets(1, 2, 10)
+    );
+    metrics::Histogram& recognition_latency = metrics::histogram(
+        "gomoku_vision_recognition_seconds", "Time to recognise the board", metrics::exponential_buckets(0.01, 2, 12)
+    );
 
-            cv::Mat mask_black, mask_white;
-            cv::inRange(blue, cv::Scalar(0, 0, 0), cv::Scalar(255, 255, 95), mask_black);
-            cv::inRange(blue, cv::Scalar(0, 0, 191), cv::Scalar(255, 63, 255), mask_white);
+    gomokuai::Coord_2D Camera::get_ai_step(
+        int desired_count, const Think& think, const std::function<void()>& on_recognised, const gomokuai::Board* also_accept
+    )
+    {
+        gomokuai::Board board, changed;
+        int desired_black = desired_count / 2 + desired_count % 2;
+        int desired_white = desired_count / 2;
+        int frame_count = 0;
+        int rejected_count = 0;
+        bool count_warned = false;
+        auto recognise_begin = std::chrono::steady_clock::now();
 
-            std::vector<cv::Vec3f> black, white;
-            for (const auto& circle: circles)
+        // 有参考帧时先只检查变化的交叉点, 多次与预期不符再整盘识别
+        int new_black = 0, new_white = 0;
+        bool incremental = config::incremental_recognition && reference.known();
+        if (incremental)
+        {
+            auto& stones = reference.board();
+            new_black = desired_black - std::count(stones.begin(), stones.end(), gomokuai::BLACK);
+            new_white = desired_white - std::count(stones.begin(), stones.end(), gomokuai::WHITE);
+            incremental = new_black >= 0 && new_white >= 0;
+        }
+        int inconsistent = 0;
+
+        ambiguous.reserve(board.size());
+        last_ambiguous.reserve(board.size());
+        consensus.reset();
+        if (interrupted.exchange(false))
+        {
+            return {};
+        }
+        pipeline.resume(!incremental);
+        while (true)
+        {
+            Frame* frame = pipeline.next();
+            if (interrupted.exchange(false) || frame->end_of_source)
             {
-                int cx = circle[0], cy = circle[1], r = circle[2];
-                if (cx - r <= 0 || cx + r >= img.cols || cy - r <= 0 || cy + r >= img.rows)
-                {
-                    continue;
-                }
-                cv::Mat black_roi = mask_black(cv::Rect(cx - r, cy - r, 2 * r, 2 * r));
-                int black_count = cv::countNonZero(black_roi);
-                if (((double)black_count) / r / r > 2.8)
-                {
-                    black.push_back(circle);
-                    continue;
-                }
-                cv::Mat white_roi = mask_white(cv::Rect(cx - r, cy - r, 2 * r, 2 * r));
-                int white_count = cv::countNonZero(white_roi);
-                if (((double)white_count) / r / r > 2.8)
+                pipeline.pause();
+                pipeline.release(frame);
+                logger.info("Recognition interrupted after {} frames.", frame_count);
+                return {};
+            }
+            frame_count++;
+            recorder.frame(frame->img);
+            if (incremental)
+            {
+                if (!reference.detect_changes(*frame, params, new_black, new_white, changed))
                 {
-                    white.push_back(circle);
+                    rejected_count++;
+                    if (++inconsistent >= config::incremental_attempts)
+                    {
+                        logger.warn("Changes do not match the expected stones, falling back to a full scan.");
+                        incremental = false;
+                        consensus.reset();
+                        pipeline.resume();
+                    }
+                    pipeline.release(frame);
                     continue;
                 }
+                consensus.add(changed);
             }
-            
-            for (int i = 0; i < 11; i++)
+            else if (!frame->valid)
             {
-                cv::line(img, cv::Point(origin + i * dx), cv::Point(origin + i * dx + Dy), cv::Scalar(0, 0, 255), 5);
-                cv::line(img, cv::Point(origin + i * dy), cv::Point(origin + i * dy + Dx), cv::Scalar(0, 0, 255), 5);
-            }
-            for (const auto& circle: anchor_circles)
-            {
-                cv::circle(img, cv::Point(circle[0], circle[1]), circle[2], cv::Scalar(255, 127, 0), 5, cv::LINE_AA, 0);
-            }
-            for (const auto& circle: anchor_circle)
-            {
-                cv::circle(img, cv::Point(circle[0], circle[1]), circle[2], cv::Scalar(255, 255, 0), 5, cv::LINE_AA, 0);
-            }
-            for (const auto& circle: circles)
-            {
-                cv::circle(img, cv::Point(circle[0], circle[1]), circle[2], cv::Scalar(0, 255, 255), 5, cv::LINE_AA, 0);
+                rejected_count++;
+                pipeline.release(frame);
+                continue;
             }
-            for (const auto& circle: black)
+            else
             {
-                cv::circle(img, cv::Point(circle[0], circle[1]), circle[2], BLACK, 5, cv::LINE_AA, 0);
+                consensus.add(frame->board);
             }
-            for (const auto& circle: white)
+            if (!consensus.decide(config::consensus_threshold, board, ambiguous))
             {
-                cv::circle(img, cv::Point(circle[0], circle[1]), circle[2], WHITE, 5, cv::LINE_AA, 0);
+                if (!ambiguous.empty() && ambiguous.size() != last_ambiguous.size())
+                {
+                    logger.warn("Ambiguous cells: {}", format_cells(ambiguous));
+                }
+                last_ambiguous.swap(ambiguous);
+                pipeline.release(frame);
+                continue;
             }
+            last_ambiguous.clear();
 
-            gomokuai::clear();
-            int chess_count = 0;
-            for (const auto& black_stone: black)
+            int black_count = std::count(board.begin(), board.end(), gomokuai::BLACK);
+            int white_count = std::count(board.begin(), board.end(), gomokuai::WHITE);
+            bool accepted = also_accept && board == *also_accept;
+            if (!accepted && (black_count != desired_black || white_count != desired_white))
             {
-                cv::Vec2f pos(black_stone[0], black_stone[1]);
-                pos -= origin;
-                float inner = pos.dot(dx);
-                int x = inner / dx.dot(dx) + 0.5f;
-                inner = pos.dot(dy);
-                int y = inner / dy.dot(dy) + 0.5f;
-                if (x >= 0 && x <= 10 && y >= 0 && y <= 10)
+                if (!count_warned)
                 {
-                    gomokuai::put_chess({x, y}, gomokuai::BLACK);
-                    chess_count++;
+                    logger.warn(
+                        "Stable board has {} black and {} white stones, expected {} and {}.",
+                        black_count, white_count, desired_black, desired_white
+                    );
+                    count_warned = true;
                 }
-            }
-            if (chess_count != desired_count / 2 + desired_count % 2)
-            {
+                rejected_count++;
+                pipeline.release(frame);
                 continue;
             }
-            chess_count = 0;
-            for (const auto& white_stone: white)
+            pipeline.pause();
+            auto recognise_end = std::chrono::steady_clock::now();
+            tracing::complete("recognise board", "vision", recognise_begin, recognise_end);
+            recognition_latency.observe(recognise_end - recognise_begin);
+            frames_processed.add(frame_count);
+            frames_rejected.add(rejected_count);
+            turn_frames.observe(frame_count);
+            turn_rejected_frames.observe(rejected_count);
+            LOG_TRACE(
+                logger, "Board recognised {} after {} frames, confidence {}.",
+                incremental ? "incrementally" : "by full scan", frame_count, consensus.min_confidence()
+            );
+            if (int count = workspace.reallocations.exchange(0))
             {
-                cv::Vec2f pos(white_stone[0], white_stone[1]);
-                pos -= origin;
-                float inner = pos.dot(dx);
-                int x = inner / dx.dot(dx) + 0.5f;
-                inner = pos.dot(dy);
-                int y = inner / dy.dot(dy) + 0.5f;
-                if (x >= 0 && x <= 10 && y >= 0 && y <= 10)
-                {
-                    gomokuai::put_chess({x, y}, gomokuai::WHITE);
-                    chess_count++;
-                }
+                logger.warn("Vision workspace reallocated {} buffers while recognising.", count);
             }
-            if (chess_count != desired_count / 2)
+            if (on_recognised)
             {
-                continue;
+                on_recognised();
             }
 
-            show_img(img, false);
+            reference.set(*frame, board);
+            recorder.board(board);
 
-            return gomokuai::get_next_point(gomokuai::BLACK);
+            auto point = think(board);
+            archive.move(*frame, reference, board, desired_count, point);
+            pipeline.release(frame);
+            return point;
         }
     }
 }
\ No newline at end of file
@@ -1,9 +1,11 @@
 #pragma once
 
+#include <functional>
 #include <opencv2/opencv.hpp>
 
 #include "../logger.hpp"
 #include "../ai/gomokuai.hpp"
+#include "vision.hpp"
 
 namespace opencv
 {
@@ -12,15 +14,100 @@ namespace opencv
     const cv::Scalar BLACK(0, 0, 0);
     const cv::Scalar WHITE(255, 255, 255);
 
-    bool init();
+    // 一台相机及其识别流水线, 增量识别的参考帧, 录制与存档, 每个工位各有一个
+    class Camera
+    {
+    public:
+        struct Options
+        {
+            int video_device_id = config::video_device_id;
+            // 不为空时用录制文件中的帧代替相机
+            string recording;
+            string vision_profile = config::vision_profile;
+            string archive_directory = config::archive_directory;
+            // 预览窗口只有一个, 只能由一台相机使用
+            bool preview = true;
+        };
 
-    void exit();
+        // 由识别出的棋盘决定落子点
+        using Think = std::function<gomokuai::Coord_2D(const gomokuai::Board&)>;
 
-    gomokuai::Coord_2D get_ai_step(int);
+        Camera(const string& station_name, const Options& options);
+
+        ~Camera();
+
+        Camera(const Camera&) = delete;
+        Camera& operator=(const Camera&) = delete;
+
+        bool init();
+
+        void exit();
+
+        // 识别出有 desired_count 颗棋子的棋盘并暂停流水线后, 先调用 on_recognised, 再由 think 决定落子点
+        // also_accept 不为空时, 与它完全相同的棋盘也接受, 不论棋子数
+        // 被 interrupt_recognition() 中断时不调用 think, 返回 (-1, -1)
+        gomokuai::Coord_2D get_ai_step(
+            int desired_count, const Think& think, const std::function<void()>& on_recognised = {},
+            const gomokuai::Board* also_accept = nullptr
+        );
+
+        // 中断 get_ai_step(), 在其他线程中调用; 中断在下一次识别时生效, 即使当时没有在识别
+        void interrupt_recognition();
+
+        // 放弃尚未生效的中断
+        void clear_interrupt();
+
+        // 把识别时处理的原始帧和最终棋盘录制到文件
+        bool start_recording(const string& path);
+
+        void stop_recording();
+
+        bool is_recording() const;
+
+        // 最近一次识别所用的网格, 以及由日志恢复棋盘和网格, 见 IncrementalReference::restore
+        bool grid(cv::Vec2f& origin, cv::Vec2f& dx, cv::Vec2f& dy) const;
+
+        void restore(const gomokuai::Board& board, cv::Vec2f origin, cv::Vec2f dx, cv::Vec2f dy);
+
+        // 标定: stage 为 0 时采集空棋盘, 为 1 时采集标定布局并搜索参数, 结果保存到 options.vision_profile
+        // 返回下一步的 stage
+        int calibrate(int stage);
+
+    private:
+        Logger logger;
+        const Options options;
+
+        cv::VideoCapture cap;
+        VisionParams params;
+        VisionWorkspace workspace;
+        Pipeline pipeline;
+        IncrementalReference reference;
+        BoardConsensus consensus;
+        std::vector<gomokuai::Coord_2D> ambiguous, last_ambiguous;
+        Recorder recorder;
+        Archive archive;
+        std::vector<CalibrationSample> calibration_samples;
+        std::atomic<bool> interrupted = false;
+
+        bool try_open_video(int index);
+
+        // 来源结束时返回 false
+        bool capture_samples(const gomokuai::Board& truth);
+
+        void search_params();
+    };
 
     inline const char window_title[] = "OpenCV Window";
 
     extern cv::Mat img;
 
     void test(gomokuai::PIECE_TYPE = gomokuai::BLACK);
+
+    // 不使用相机和窗口, 以最快速度把录制的帧送入识别流水线, 统计各阶段耗时和识别准确率
+    // 使用 profile 中的识别参数, 文件不存在时使用默认值
+    void replay(const char* path, const string& profile = config::vision_profile);
+
+    // 在随机生成的模拟图像上测试识别耗时与逐格错误率, profile 同 replay
+    // resolution_scale 为相对 3000x2000 的相机分辨率, 识别参数中以像素计的量随之缩放
+    void vision_benchmark(int frame_count, uint64_t seed, const string& profile = config::vision_profile, float resolution_scale = 1);
 }
\ No newline at end of file
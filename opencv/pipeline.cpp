@@ -0,0 +1,226 @@
+#include "vision.hpp"
+#include "opencv.hpp"
+
+#include "../tracing.hpp"
+#include "../config.hpp"
+
+namespace opencv
+{
+    Pipeline::Pipeline(const Logger& logger, const string& station_name, VisionWorkspace& workspace, const VisionParams& params, bool preview):
+        logger(logger),
+        station_name(station_name),
+        workspace(workspace),
+        params(params),
+        preview(preview)
+    {}
+
+    Pipeline::~Pipeline()
+    {
+        stop();
+    }
+
+    void Pipeline::capture_stage()
+    {
+        tracing::set_thread_name(instance_name("vision capture", station_name).c_str());
+        while (true)
+        {
+            capturing.wait(false);
+            Frame* frame;
+            free_frames.wait_pop(frame);
+            if (frame == nullptr || stopping)
+            {
+                break;
+            }
+            frame->generation = generation;
+            frame->full = full_processing;
+            frame->sequence = sequence++;
+            frame->source_index = -1;
+            frame->end_of_source = false;
+            frame->stamp(CAPTURE_BEGIN);
+            tracing::Span span("capture", "vision");
+            bool interrupted = interrupting.exchange(false);
+            while (!interrupted && !frame_source(*frame))
+            {
+                if (stopping)
+                {
+                    captured_frames.push(nullptr);
+                    return;
+                }
+                logger.warn("Failed to read a frame, retrying.");
+                // 数据源暂停采集时 (如回放结束) 等待恢复或退出
+                capturing.wait(false);
+                interrupted = interrupting.exchange(false);
+            }
+            if (interrupted || frame->end_of_source)
+            {
+                // 结束帧不做识别, 之后暂停采集; 期间已有新的 resume() 时继续采集
+                frame->end_of_source = true;
+                frame->full = false;
+                capturing = false;
+                if (generation != frame->generation)
+                {
+                    capturing = true;
+                }
+            }
+            frame->stamp(CAPTURED);
+            captured_frames.push(frame);
+        }
+        captured_frames.push(nullptr);
+    }
+
+    void Pipeline::preprocess_stage()
+    {
+        tracing::set_thread_name(instance_name("vision preprocess", station_name).c_str());
+        while (true)
+        {
+            Frame* frame;
+            captured_frames.wait_pop(frame);
+            if (frame != nullptr && frame->full)
+            {
+                tracing::Span span("preprocess", "vision");
+                preprocess(*frame, params);
+                frame->stamp(PREPROCESSED);
+            }
+            anchor_frames.push(frame);
+            stone_frames.push(frame);
+            if (frame == nullptr)
+            {
+                return;
+            }
+        }
+    }
+
+    void Pipeline::worker_stage(FrameQueue& in, FrameQueue& out, void (*work)(Frame&, const VisionParams&), FRAME_STAGE stage, const char* name)
+    {
+        tracing::set_thread_name(instance_name(name, station_name).c_str());
+        while (true)
+        {
+            Frame* frame;
+            in.wait_pop(frame);
+            if (frame != nullptr && frame->full)
+            {
+                tracing::Span span(name, "vision");
+                work(*frame, params);
+                frame->stamp(stage);
+            }
+            out.push(frame);
+            if (frame == nullptr)
+            {
+                return;
+            }
+        }
+    }
+
+    void Pipeline::assemble_stage()
+    {
+        tracing::set_thread_name(instance_name("vision assemble", station_name).c_str());
+        while (true)
+        {
+            Frame *frame, *stone_frame;
+            anchor_done_frames.wait_pop(frame);
+            stone_done_frames.wait_pop(stone_frame);
+            if (frame == nullptr)
+            {
+                board_frames.push(nullptr);
+                return;
+            }
+            if (frame->full)
+            {
+                tracing::Span span("assemble", "vision");
+                assemble_board(*frame);
+            }
+            else
+            {
+                frame->clear_detection();
+            }
+            frame->stamp(ASSEMBLED);
+            if (int count = frame->check_buffers())
+            {
+                workspace.reallocations += count;
+            }
+            if (preview && !frame->end_of_source)
+            {
+                publish_preview(*frame);
+            }
+            board_frames.push(frame);
+        }
+    }
+
+    void Pipeline::start(FrameSource source)
+    {
+        frame_source = std::move(source);
+        capturing = false;
+        stopping = false;
+        sequence = 0;
+        for (auto& frame: workspace.frames)
+        {
+            free_frames.push(&frame);
+        }
+        stage_threads[0] = std::thread(&Pipeline::capture_stage, this);
+        stage_threads[1] = std::thread(&Pipeline::preprocess_stage, this);
+        stage_threads[2] = std::thread(&Pipeline::worker_stage, this, std::ref(anchor_frames), std::ref(anchor_done_frames), detect_anchors, ANCHORS_DETECTED, "detect anchors");
+        stage_threads[3] = std::thread(&Pipeline::worker_stage, this, std::ref(stone_frames), std::ref(stone_done_frames), detect_stones, STONES_DETECTED, "detect stones");
+        stage_threads[4] = std::thread(&Pipeline::assemble_stage, this);
+        is_running = true;
+    }
+
+    void Pipeline::stop()
+    {
+        if (!is_running)
+        {
+            return;
+        }
+        stopping = true;
+        free_frames.push(nullptr);
+        capturing = true;
+        capturing.notify_one();
+        for (auto& thread: stage_threads)
+        {
+            thread.join();
+        }
+        // 清空队列, 以便再次启动
+        Frame* frame;
+        while (free_frames.pop(frame));
+        while (board_frames.pop(frame));
+        is_running = false;
+    }
+
+    void Pipeline::resume(bool full)
+    {
+        full_processing = full;
+        generation++;
+        capturing = true;
+        capturing.notify_one();
+    }
+
+    void Pipeline::pause()
+    {
+        capturing = false;
+    }
+
+    void Pipeline::interrupt()
+    {
+        interrupting = true;
+        capturing = true;
+        capturing.notify_one();
+    }
+
+    Frame* Pipeline::next()
+    {
+        while (true)
+        {
+            Frame* frame;
+            board_frames.wait_pop(frame);
+            if (frame->generation == generation)
+            {
+                return frame;
+            }
+            free_frames.push(frame);
+        }
+    }
+
+    void Pipeline::release(Frame* frame)
+    {
+        free_frames.push(frame);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,146 @@
+#include "vision.hpp"
+#include "opencv.hpp"
+
+#include <thread>
+
+#include "../triple_buffer.hpp"
+#include "../config.hpp"
+
+namespace opencv
+{
+    struct PreviewFrame
+    {
+        cv::Mat img;
+        Detection detection;
+        float scale = 1;
+    };
+
+    TripleBuffer<PreviewFrame> preview_buffer;
+    std::atomic<bool> preview_visible = false;
+
+    std::thread window_thread;
+    std::atomic<bool> is_active = false;
+
+    void Detection::assign(const Frame& frame)
+    {
+        valid = frame.valid;
+        origin = frame.origin;
+        dx = frame.dx;
+        dy = frame.dy;
+        anchor_circles.assign(frame.anchor_circles.begin(), frame.anchor_circles.end());
+        anchor_circle.assign(frame.anchor_circle.begin(), frame.anchor_circle.end());
+        circles.assign(frame.circles.begin(), frame.circles.end());
+        black.assign(frame.black.begin(), frame.black.end());
+        white.assign(frame.white.begin(), frame.white.end());
+    }
+
+    void Detection::clear()
+    {
+        valid = false;
+        for (auto circle_list: {&anchor_circles, &anchor_circle, &circles, &black, &white})
+        {
+            circle_list->clear();
+        }
+    }
+
+    void draw_circles(cv::Mat& img, const std::vector<cv::Vec3f>& circles, const cv::Scalar& color, float scale, int thickness)
+    {
+        for (const auto& circle: circles)
+        {
+            cv::circle(img, cv::Point(circle[0] * scale, circle[1] * scale), circle[2] * scale, color, thickness, cv::LINE_AA, 0);
+        }
+    }
+
+    void Detection::draw(cv::Mat& img, float scale) const
+    {
+        int thickness = std::max(1, (int)(5 * scale));
+        if (valid)
+        {
+            auto o = origin * scale;
+            auto Dx = dx * 10 * scale;
+            auto Dy = dy * 10 * scale;
+            for (int i = 0; i < 11; i++)
+            {
+                cv::line(img, cv::Point(o + i * scale * dx), cv::Point(o + i * scale * dx + Dy), cv::Scalar(0, 0, 255), thickness);
+                cv::line(img, cv::Point(o + i * scale * dy), cv::Point(o + i * scale * dy + Dx), cv::Scalar(0, 0, 255), thickness);
+            }
+        }
+        draw_circles(img, anchor_circles, cv::Scalar(255, 127, 0), scale, thickness);
+        draw_circles(img, anchor_circle, cv::Scalar(255, 255, 0), scale, thickness);
+        draw_circles(img, circles, cv::Scalar(0, 255, 255), scale, thickness);
+        draw_circles(img, black, BLACK, scale, thickness);
+        draw_circles(img, white, WHITE, scale, thickness);
+    }
+
+    PreviewFrame& prepare_preview(const cv::Mat& img)
+    {
+        auto& preview = preview_buffer.write_buffer();
+        preview.scale = (float)config::preview_width / img.cols;
+        cv::resize(img, preview.img, cv::Size(config::preview_width, img.rows * preview.scale), 0, 0, cv::INTER_NEAREST);
+        return preview;
+    }
+
+    void publish_preview(const Frame& frame)
+    {
+        if (!preview_visible)
+        {
+            return;
+        }
+        auto& preview = prepare_preview(frame.img);
+        preview.detection.assign(frame);
+        preview_buffer.publish();
+    }
+
+    void publish_preview(const cv::Mat& img)
+    {
+        if (!preview_visible)
+        {
+            return;
+        }
+        auto& preview = prepare_preview(img);
+        preview.detection.clear();
+        preview_buffer.publish();
+    }
+
+    void window_thread_run()
+    {
+        cv::namedWindow(window_title, cv::WINDOW_NORMAL);
+        cv::Mat canvas;
+        while (is_active)
+        {
+            if (preview_buffer.update())
+            {
+                auto& preview = preview_buffer.read_buffer();
+                preview.img.copyTo(canvas);
+                preview.detection.draw(canvas, preview.scale);
+                cv::imshow(window_title, canvas);
+            }
+            cv::waitKey(10);
+            // 不支持该属性的后端返回 -1, 按可见处理
+            preview_visible = cv::getWindowProperty(window_title, cv::WND_PROP_VISIBLE) != 0;
+        }
+        cv::destroyAllWindows();
+    }
+
+    void preview_start()
+    {
+        if (is_active)
+        {
+            return;
+        }
+        is_active = true;
+        preview_visible = true;
+        window_thread = std::thread(window_thread_run);
+    }
+
+    void preview_stop()
+    {
+        if (!is_active)
+        {
+            return;
+        }
+        is_active = false;
+        preview_visible = false;
+        window_thread.join();
+    }
+}
\ No newline at end of file
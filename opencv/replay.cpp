@@ -0,0 +1,456 @@
+#include "opencv.hpp"
+#include "vision.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#include "../config.hpp"
+
+namespace opencv
+{
+    // 录制文件: 文件头之后是一串记录, 每条记录为 类型(1 字节) + 长度(4 字节) + 内容
+    // 帧记录的内容为 PNG 编码的原始帧, 棋盘记录为在它之前的帧所对应的最终识别结果
+    const char record_magic[8] = {'G', 'M', 'K', 'R', 'E', 'C', '0', '1'};
+
+    enum RECORD_TYPE : uint8_t
+    {
+        RECORD_FRAME,
+        RECORD_BOARD,
+    };
+
+    struct RecordSlot
+    {
+        RECORD_TYPE type;
+        cv::Mat img;
+        gomokuai::Board board;
+    };
+
+    Recorder::Recorder(const Logger& logger):
+        logger(logger),
+        slots(new RecordSlot[depth])
+    {
+    }
+
+    Recorder::~Recorder()
+    {
+        stop();
+    }
+
+    void write_record(std::ostream& os, RECORD_TYPE type, const void* data, uint32_t length)
+    {
+        os.write((const char*)&type, sizeof(type));
+        os.write((const char*)&length, sizeof(length));
+        os.write((const char*)data, length);
+    }
+
+    void Recorder::run()
+    {
+        std::vector<uchar> buf;
+        const std::vector<int> params{cv::IMWRITE_PNG_COMPRESSION, 1};
+        while (true)
+        {
+            RecordSlot* slot;
+            pending.wait_pop(slot);
+            if (slot == nullptr)
+            {
+                return;
+            }
+            if (slot->type == RECORD_FRAME)
+            {
+                cv::imencode(".png", slot->img, buf, params);
+                write_record(file, RECORD_FRAME, buf.data(), buf.size());
+            }
+            else
+            {
+                write_record(file, RECORD_BOARD, slot->board.data(), sizeof(gomokuai::Board));
+                file.flush();
+            }
+            free_slots.push(slot);
+        }
+    }
+
+    bool Recorder::start(const string& path)
+    {
+        auto guard = std::lock_guard(lock);
+        if (recording)
+        {
+            return true;
+        }
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            logger.error("Cannot open record file {}.", path);
+            return false;
+        }
+        uint32_t size = config::board_size;
+        file.write(record_magic, sizeof(record_magic));
+        file.write((const char*)&size, sizeof(size));
+        for (std::size_t i = 0; i < depth; i++)
+        {
+            free_slots.push(&slots[i]);
+        }
+        dropped_frames = 0;
+        thread = std::thread(&Recorder::run, this);
+        recording = true;
+        logger.info("Recording frames to {}.", path);
+        return true;
+    }
+
+    void Recorder::stop()
+    {
+        // 先置 stopping, 让正在等待空闲槽位的 board() 放弃并释放 lock
+        stopping = true;
+        auto guard = std::lock_guard(lock);
+        stopping = false;
+        if (!recording)
+        {
+            return;
+        }
+        recording = false;
+        pending.push(nullptr);
+        thread.join();
+        file.close();
+        RecordSlot* slot;
+        while (free_slots.pop(slot));
+        logger.info("Recording stopped, {} frames dropped.", dropped_frames);
+    }
+
+    void Recorder::frame(const cv::Mat& img)
+    {
+        RecordSlot* slot;
+        auto guard = std::lock_guard(lock);
+        if (!recording)
+        {
+            return;
+        }
+        // 编码跟不上时丢帧, 不阻塞识别
+        if (!free_slots.pop(slot))
+        {
+            dropped_frames++;
+            return;
+        }
+        slot->type = RECORD_FRAME;
+        img.copyTo(slot->img);
+        pending.push(slot);
+    }
+
+    bool Recorder::board(const gomokuai::Board& board)
+    {
+        RecordSlot* slot;
+        auto guard = std::lock_guard(lock);
+        if (!recording)
+        {
+            return false;
+        }
+        // 棋盘是前面各帧的标注, 不能丢弃, 等待录制线程空出槽位; 正在停止录制时放弃
+        while (!free_slots.pop(slot))
+        {
+            if (stopping)
+            {
+                logger.warn("Recording is stopping, the last board is not recorded.");
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        slot->type = RECORD_BOARD;
+        slot->board = board;
+        pending.push(slot);
+        return true;
+    }
+
+    struct RecordedFrame
+    {
+        std::streampos offset;
+        uint32_t length;
+        // 对应的棋盘记录下标, -1 表示录制结束前没有棋盘记录
+        int turn;
+    };
+
+    bool read_record_header(std::istream& is, RECORD_TYPE& type, uint32_t& length)
+    {
+        is.read((char*)&type, sizeof(type));
+        is.read((char*)&length, sizeof(length));
+        return (bool)is;
+    }
+
+    // 打开时扫描一遍录制文件, 记录每一帧的位置, 之后按下标随机读取
+    struct Recording
+    {
+        std::ifstream file;
+        std::vector<RecordedFrame> frames;
+        std::vector<gomokuai::Board> boards;
+        std::vector<uchar> buf;
+
+        bool open(const char* path)
+        {
+            file.open(path, std::ios::binary);
+            char magic[sizeof(record_magic)];
+            uint32_t size = 0;
+            file.read(magic, sizeof(magic));
+            file.read((char*)&size, sizeof(size));
+            if (!file || memcmp(magic, record_magic, sizeof(magic)) != 0 || size != config::board_size)
+            {
+                logger.error("{} is not a recording of a {}x{} board.", path, config::board_size, config::board_size);
+                return false;
+            }
+
+            file.seekg(0, std::ios::end);
+            std::streamoff file_size = file.tellg();
+            file.seekg(sizeof(record_magic) + sizeof(size));
+
+            uint32_t max_length = 0;
+            RECORD_TYPE type;
+            uint32_t length;
+            while (read_record_header(file, type, length))
+            {
+                if ((std::streamoff)file.tellg() + length > file_size)
+                {
+                    // 进程被终止时最后一条记录可能没有写完
+                    logger.warn("Ignoring a truncated record at the end of {}.", path);
+                    break;
+                }
+                if (type == RECORD_FRAME)
+                {
+                    frames.push_back({file.tellg(), length, -1});
+                    max_length = std::max(max_length, length);
+                    file.seekg(length, std::ios::cur);
+                }
+                else if (type == RECORD_BOARD && length == sizeof(gomokuai::Board))
+                {
+                    auto& board = boards.emplace_back();
+                    file.read((char*)board.data(), length);
+                    for (auto it = frames.rbegin(); it != frames.rend() && it->turn == -1; it++)
+                    {
+                        it->turn = boards.size() - 1;
+                    }
+                }
+                else
+                {
+                    logger.error("Corrupted record at offset {}.", (long long)file.tellg());
+                    break;
+                }
+            }
+            if (frames.empty())
+            {
+                logger.error("No frames in {}.", path);
+                return false;
+            }
+            file.clear();
+            buf.resize(max_length);
+            return true;
+        }
+
+        // 从 index 开始读出第一个能解码的帧, index 更新为该帧的下标; 之后没有能解码的帧时返回 false
+        bool read(std::size_t& index, cv::Mat& img)
+        {
+            for (; index < frames.size(); index++)
+            {
+                auto& frame = frames[index];
+                file.seekg(frame.offset);
+                file.read((char*)buf.data(), frame.length);
+                if (file)
+                {
+                    cv::imdecode(cv::Mat(1, frame.length, CV_8UC1, buf.data()), cv::IMREAD_COLOR, &img);
+                    if (!img.empty())
+                    {
+                        return true;
+                    }
+                }
+                file.clear();
+                logger.warn("Skipping undecodable frame {} of the recording.", index);
+            }
+            return false;
+        }
+    };
+
+    FrameSource recording_source(const char* path)
+    {
+        auto recording = std::make_shared<Recording>();
+        if (!recording->open(path))
+        {
+            return {};
+        }
+        logger.info("Using {} frames of {} turns from {} as the camera.", recording->frames.size(), recording->boards.size(), path);
+        // 帧按录制顺序送出, 读完后一直重复最后一帧
+        return [recording, next = std::size_t(0), last = std::size_t(0)](Frame& frame) mutable
+        {
+            if (recording->read(next, frame.img))
+            {
+                frame.source_index = next;
+                last = next++;
+                return true;
+            }
+            std::size_t index = last;
+            if (!recording->read(index, frame.img))
+            {
+                return false;
+            }
+            frame.source_index = index;
+            return true;
+        };
+    }
+
+    string summarise(std::vector<double>& samples)
+    {
+        if (samples.empty())
+        {
+            return "no samples";
+        }
+        std::sort(samples.begin(), samples.end());
+        auto percentile = [&](double p){ return samples[std::min(samples.size() - 1, (std::size_t)(p * samples.size()))]; };
+        return format(
+            "p50 {:.1f} ms, p90 {:.1f} ms, p99 {:.1f} ms, max {:.1f} ms",
+            percentile(0.5), percentile(0.9), percentile(0.99), samples.back()
+        );
+    }
+
+    double elapsed_ms(const Frame& frame, FRAME_STAGE from, FRAME_STAGE to)
+    {
+        return std::chrono::duration<double, std::milli>(frame.timestamps[to] - frame.timestamps[from]).count();
+    }
+
+    void replay(const char* path, const string& profile)
+    {
+        Recording recording;
+        if (!recording.open(path))
+        {
+            return;
+        }
+        auto& recorded = recording.frames;
+        auto& boards = recording.boards;
+        logger.info("Replaying {} frames of {} turns from {}.", recorded.size(), boards.size(), path);
+
+        // 回放使用独立的参数和帧缓冲区, 不影响各工位
+        VisionWorkspace workspace;
+        VisionParams params;
+        if (load_vision_params(profile, params))
+        {
+            logger.info("Vision profile loaded from {}.", profile);
+        }
+        else
+        {
+            logger.warn("No vision profile at {}, using default parameters.", profile);
+        }
+        Pipeline pipeline(logger, "", workspace, params, false);
+
+        cv::Mat first;
+        std::size_t next = 0;
+        if (!recording.read(next, first))
+        {
+            logger.error("No decodable frames in {}.", path);
+            return;
+        }
+        workspace.allocate(first.size());
+
+        // 无法解码的帧在读取时跳过, 每一帧带上它在录制文件中的下标
+        auto read_recorded = [&](Frame& frame)
+        {
+            if (!recording.read(next, frame.img))
+            {
+                frame.end_of_source = true;
+                return true;
+            }
+            frame.source_index = next++;
+            return true;
+        };
+
+        std::vector<double> stage_ms[6];
+        const char* stage_names[6] = {"decode", "preprocess", "anchors", "stones", "assemble", "total"};
+        std::size_t labelled = 0, invalid = 0, correct = 0, cell_errors = 0;
+        BoardConsensus consensus(config::consensus_frames);
+        std::vector<gomokuai::Coord_2D> ambiguous;
+        int current_turn = -1;
+        bool turn_decided = false;
+        int turn_frames = 0;
+        std::size_t decided = 0, decided_correct = 0;
+        std::vector<double> frames_to_decision;
+
+        auto begin = std::chrono::steady_clock::now();
+        pipeline.start(read_recorded);
+        pipeline.resume();
+        std::size_t processed = 0;
+        while (true)
+        {
+            Frame* frame = pipeline.next();
+            if (frame->end_of_source)
+            {
+                pipeline.release(frame);
+                break;
+            }
+            processed++;
+            stage_ms[0].push_back(elapsed_ms(*frame, CAPTURE_BEGIN, CAPTURED));
+            stage_ms[1].push_back(elapsed_ms(*frame, CAPTURED, PREPROCESSED));
+            stage_ms[2].push_back(elapsed_ms(*frame, PREPROCESSED, ANCHORS_DETECTED));
+            stage_ms[3].push_back(elapsed_ms(*frame, PREPROCESSED, STONES_DETECTED));
+            auto detected = frame->timestamps[ANCHORS_DETECTED] > frame->timestamps[STONES_DETECTED] ? ANCHORS_DETECTED : STONES_DETECTED;
+            stage_ms[4].push_back(elapsed_ms(*frame, detected, ASSEMBLED));
+            stage_ms[5].push_back(elapsed_ms(*frame, CAPTURE_BEGIN, ASSEMBLED));
+
+            int turn = recorded[frame->source_index].turn;
+            if (turn >= 0)
+            {
+                auto& truth = boards[turn];
+                labelled++;
+                if (!frame->valid)
+                {
+                    invalid++;
+                }
+                else
+                {
+                    int errors = 0;
+                    for (int j = 0; j < (int)truth.size(); j++)
+                    {
+                        errors += frame->board[j] != truth[j];
+                    }
+                    cell_errors += errors;
+                    correct += errors == 0;
+                }
+
+                // 与 get_ai_step() 相同的多帧投票
+                if (turn != current_turn)
+                {
+                    current_turn = turn;
+                    turn_decided = false;
+                    turn_frames = 0;
+                    consensus.reset();
+                }
+                turn_frames++;
+                gomokuai::Board board;
+                if (!turn_decided && frame->valid)
+                {
+                    consensus.add(frame->board);
+                    if (consensus.decide(config::consensus_threshold, board, ambiguous))
+                    {
+                        turn_decided = true;
+                        decided++;
+                        decided_correct += board == truth;
+                        frames_to_decision.push_back(turn_frames);
+                    }
+                }
+            }
+            pipeline.release(frame);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        pipeline.stop();
+
+        logger.info("Processed {} frames in {:.2f} s, {:.2f} frames/s.", processed, seconds, processed / seconds);
+        for (int i = 0; i < 6; i++)
+        {
+            logger.info("{:>10}: {}", stage_names[i], summarise(stage_ms[i]));
+        }
+        if (labelled > 0)
+        {
+            logger.info(
+                "Frames: {} labelled, {} without anchors, {} fully correct ({:.1f}%), cell error rate {:.4f}%.",
+                labelled, invalid, correct, 100.0 * correct / labelled,
+                100.0 * cell_errors / (labelled * config::board_size * config::board_size)
+            );
+            std::sort(frames_to_decision.begin(), frames_to_decision.end());
+            logger.info(
+                "Turns: {} recorded, {} decided by consensus, {} of them correct, median {} frames to decide.",
+                boards.size(), decided, decided_correct,
+                frames_to_decision.empty() ? 0 : frames_to_decision[frames_to_decision.size() / 2]
+            );
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,132 @@
+#include "vision.hpp"
+
+#include <opencv2/core/hal/intrin.hpp>
+
+namespace opencv
+{
+    // 灰度权重 (0.114, 0.587, 0.299) 的 8 位定点近似, 与 cvtColor 的结果相差不超过 1
+    const ushort GREY_B = 29, GREY_G = 150, GREY_R = 77;
+
+    inline bool in_range(uchar b, uchar g, uchar r, const uchar low[3], const uchar high[3])
+    {
+        return b >= low[0] && b <= high[0] && g >= low[1] && g <= high[1] && r >= low[2] && r <= high[2];
+    }
+
+    // S = round(255 * (V - min) / V) <= max_saturation 的整数形式, 除恰好取整的边界外与 cvtColor 一致
+    inline bool saturation_below(int value, int diff, int max_saturation)
+    {
+        return diff * 255 <= max_saturation * value + (value >> 1);
+    }
+
+    void segment_rows(
+        const cv::Mat& img, const ColourThresholds& t,
+        cv::Mat& anchor, cv::Mat& main_anchor, cv::Mat& grey, cv::Mat& black, cv::Mat& white,
+        const cv::Range& rows
+    )
+    {
+        for (int y = rows.start; y < rows.end; y++)
+        {
+            const uchar* src = img.ptr<uchar>(y);
+            uchar* anchor_row = anchor.ptr<uchar>(y);
+            uchar* main_anchor_row = main_anchor.ptr<uchar>(y);
+            uchar* grey_row = grey.ptr<uchar>(y);
+            uchar* black_row = black.ptr<uchar>(y);
+            uchar* white_row = white.ptr<uchar>(y);
+            int x = 0;
+#if CV_SIMD
+            const int lanes = CV_SIMD_WIDTH;
+            const cv::v_uint8 anchor_low[3] = {
+                cv::vx_setall_u8(t.anchor_low[0]), cv::vx_setall_u8(t.anchor_low[1]), cv::vx_setall_u8(t.anchor_low[2])
+            };
+            const cv::v_uint8 anchor_high[3] = {
+                cv::vx_setall_u8(t.anchor_high[0]), cv::vx_setall_u8(t.anchor_high[1]), cv::vx_setall_u8(t.anchor_high[2])
+            };
+            const cv::v_uint8 main_low[3] = {
+                cv::vx_setall_u8(t.main_anchor_low[0]), cv::vx_setall_u8(t.main_anchor_low[1]), cv::vx_setall_u8(t.main_anchor_low[2])
+            };
+            const cv::v_uint8 main_high[3] = {
+                cv::vx_setall_u8(t.main_anchor_high[0]), cv::vx_setall_u8(t.main_anchor_high[1]), cv::vx_setall_u8(t.main_anchor_high[2])
+            };
+            const cv::v_uint8 black_max = cv::vx_setall_u8(t.black_max_value);
+            const cv::v_uint8 white_min = cv::vx_setall_u8(t.white_min_value);
+            const cv::v_uint16 saturation_max = cv::vx_setall_u16(t.white_max_saturation);
+            const cv::v_uint16 full_scale = cv::vx_setall_u16(255);
+            const cv::v_uint16 grey_b = cv::vx_setall_u16(GREY_B);
+            const cv::v_uint16 grey_g = cv::vx_setall_u16(GREY_G);
+            const cv::v_uint16 grey_r = cv::vx_setall_u16(GREY_R);
+            const cv::v_uint16 grey_round = cv::vx_setall_u16(128);
+            for (; x <= img.cols - lanes; x += lanes)
+            {
+                cv::v_uint8 b, g, r;
+                cv::v_load_deinterleave(src + 3 * x, b, g, r);
+
+                cv::v_store(anchor_row + x,
+                    (b >= anchor_low[0]) & (b <= anchor_high[0]) &
+                    (g >= anchor_low[1]) & (g <= anchor_high[1]) &
+                    (r >= anchor_low[2]) & (r <= anchor_high[2])
+                );
+                cv::v_store(main_anchor_row + x,
+                    (b >= main_low[0]) & (b <= main_high[0]) &
+                    (g >= main_low[1]) & (g <= main_high[1]) &
+                    (r >= main_low[2]) & (r <= main_high[2])
+                );
+
+                cv::v_uint8 value = cv::v_max(cv::v_max(b, g), r);
+                cv::v_uint8 diff = value - cv::v_min(cv::v_min(b, g), r);
+                cv::v_store(black_row + x, value <= black_max);
+
+                cv::v_uint16 value_lo, value_hi, diff_lo, diff_hi;
+                cv::v_expand(value, value_lo, value_hi);
+                cv::v_expand(diff, diff_lo, diff_hi);
+                cv::v_uint8 saturation_ok = cv::v_pack(
+                    diff_lo * full_scale <= value_lo * saturation_max + cv::v_shr<1>(value_lo),
+                    diff_hi * full_scale <= value_hi * saturation_max + cv::v_shr<1>(value_hi)
+                );
+                cv::v_store(white_row + x, (value >= white_min) & saturation_ok);
+
+                cv::v_uint16 b_lo, b_hi, g_lo, g_hi, r_lo, r_hi;
+                cv::v_expand(b, b_lo, b_hi);
+                cv::v_expand(g, g_lo, g_hi);
+                cv::v_expand(r, r_lo, r_hi);
+                cv::v_store(grey_row + x, cv::v_pack(
+                    cv::v_shr<8>(b_lo * grey_b + g_lo * grey_g + r_lo * grey_r + grey_round),
+                    cv::v_shr<8>(b_hi * grey_b + g_hi * grey_g + r_hi * grey_r + grey_round)
+                ));
+            }
+#endif
+            for (; x < img.cols; x++)
+            {
+                uchar b = src[3 * x], g = src[3 * x + 1], r = src[3 * x + 2];
+                anchor_row[x] = in_range(b, g, r, t.anchor_low, t.anchor_high) ? 255 : 0;
+                main_anchor_row[x] = in_range(b, g, r, t.main_anchor_low, t.main_anchor_high) ? 255 : 0;
+
+                int value = std::max({b, g, r});
+                int diff = value - std::min({b, g, r});
+                black_row[x] = value <= t.black_max_value ? 255 : 0;
+                white_row[x] = value >= t.white_min_value && saturation_below(value, diff, t.white_max_saturation) ? 255 : 0;
+
+                grey_row[x] = (b * GREY_B + g * GREY_G + r * GREY_R + 128) >> 8;
+            }
+        }
+#if CV_SIMD
+        cv::vx_cleanup();
+#endif
+    }
+
+    void segment(
+        const cv::Mat& img, const ColourThresholds& thresholds,
+        cv::Mat& anchor, cv::Mat& main_anchor, cv::Mat& grey, cv::Mat& black, cv::Mat& white
+    )
+    {
+        CV_Assert(img.type() == CV_8UC3);
+        for (auto mask: {&anchor, &main_anchor, &grey, &black, &white})
+        {
+            mask->create(img.size(), CV_8UC1);
+        }
+        // 每块至少 64 行, 避免线程调度开销超过计算量
+        cv::parallel_for_(cv::Range(0, img.rows), [&](const cv::Range& rows)
+        {
+            segment_rows(img, thresholds, anchor, main_anchor, grey, black, white, rows);
+        }, img.rows / 64.0);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include "vision.hpp"
+#include "opencv.hpp"
+
+#include <cmath>
+
+namespace opencv
+{
+    // 单帧可能检测到的圆的数量上限, 用于预留容量
+    const int max_circles = 256;
+
+    void Frame::allocate(cv::Size size)
+    {
+        img.create(size, CV_8UC3);
+        anchor_raw.create(size, CV_8UC1);
+        anchor_mask.create(size, CV_8UC1);
+        main_anchor_raw.create(size, CV_8UC1);
+        main_anchor_mask.create(size, CV_8UC1);
+        grey_raw.create(size, CV_8UC1);
+        grey.create(size, CV_8UC1);
+        mask_black.create(size, CV_8UC1);
+        mask_white.create(size, CV_8UC1);
+        for (auto circle_list: {&anchor_circles, &anchor_circle, &circles, &black, &white})
+        {
+            circle_list->reserve(max_circles);
+        }
+        buffer_addresses = get_buffer_addresses();
+    }
+
+    std::array<const void*, 14> Frame::get_buffer_addresses() const
+    {
+        return {
+            img.data, anchor_raw.data, anchor_mask.data, main_anchor_raw.data, main_anchor_mask.data,
+            grey_raw.data, grey.data, mask_black.data, mask_white.data,
+            anchor_circles.data(), anchor_circle.data(), circles.data(), black.data(), white.data()
+        };
+    }
+
+    int Frame::check_buffers()
+    {
+        auto addresses = get_buffer_addresses();
+        int count = 0;
+        for (int i = 0; i < (int)addresses.size(); i++)
+        {
+            if (addresses[i] != buffer_addresses[i])
+            {
+                count++;
+            }
+        }
+        buffer_addresses = addresses;
+        return count;
+    }
+
+    void Frame::clear_detection()
+    {
+        valid = false;
+        for (auto circle_list: {&anchor_circles, &anchor_circle, &circles, &black, &white})
+        {
+            circle_list->clear();
+        }
+        board.fill(gomokuai::EMPTY);
+        black_count = 0;
+        white_count = 0;
+    }
+
+    void VisionWorkspace::allocate(cv::Size size)
+    {
+        for (auto& frame: frames)
+        {
+            frame.allocate(size);
+        }
+        reallocations = 0;
+    }
+
+    void preprocess(Frame& frame, const VisionParams& params)
+    {
+        segment(
+            frame.img, params.colour,
+            frame.anchor_raw, frame.main_anchor_raw, frame.grey_raw, frame.mask_black, frame.mask_white
+        );
+        cv::GaussianBlur(frame.anchor_raw, frame.anchor_mask, cv::Size(5, 5), 0);
+        cv::GaussianBlur(frame.main_anchor_raw, frame.main_anchor_mask, cv::Size(5, 5), 0);
+        cv::GaussianBlur(frame.grey_raw, frame.grey, cv::Size(5, 5), 0);
+    }
+
+    void detect_anchors(Frame& frame, const VisionParams& params)
+    {
+        auto& p = params.anchor_hough;
+        cv::HoughCircles(frame.anchor_mask, frame.anchor_circles, cv::HOUGH_GRADIENT, 1, p.min_dist, p.param1, p.param2, p.min_radius, p.max_radius);
+        cv::HoughCircles(frame.main_anchor_mask, frame.anchor_circle, cv::HOUGH_GRADIENT, 1, p.min_dist, p.param1, p.param2, p.min_radius, p.max_radius);
+    }
+
+    void detect_stones(Frame& frame, const VisionParams& params)
+    {
+        auto& p = params.stone_hough;
+        cv::HoughCircles(frame.grey, frame.circles, cv::HOUGH_GRADIENT, 1, p.min_dist, p.param1, p.param2, p.min_radius, p.max_radius);
+
+        frame.black.clear();
+        frame.white.clear();
+        for (const auto& circle: frame.circles)
+        {
+            int cx = circle[0], cy = circle[1], r = circle[2];
+            if (cx - r <= 0 || cx + r >= frame.img.cols || cy - r <= 0 || cy + r >= frame.img.rows)
+            {
+                continue;
+            }
+            cv::Mat black_roi = frame.mask_black(cv::Rect(cx - r, cy - r, 2 * r, 2 * r));
+            int black_count = cv::countNonZero(black_roi);
+            if (((double)black_count) / r / r > params.stone_fill_ratio)
+            {
+                frame.black.push_back(circle);
+                continue;
+            }
+            cv::Mat white_roi = frame.mask_white(cv::Rect(cx - r, cy - r, 2 * r, 2 * r));
+            int white_count = cv::countNonZero(white_roi);
+            if (((double)white_count) / r / r > params.stone_fill_ratio)
+            {
+                frame.white.push_back(circle);
+                continue;
+            }
+        }
+    }
+
+    bool cell_patch(
+        const cv::Vec2f& origin, const cv::Vec2f& dx, const cv::Vec2f& dy,
+        int row, int col, const cv::Size& size, cv::Rect& rect
+    )
+    {
+        cv::Vec2f center = origin + row * dx + col * dy;
+        float spacing = std::sqrt(std::min(dx.dot(dx), dy.dot(dy)));
+        int half = 0.3f * spacing;
+        rect = cv::Rect(center[0] - half, center[1] - half, 2 * half, 2 * half);
+        return rect.x >= 0 && rect.y >= 0 && rect.x + rect.width <= size.width && rect.y + rect.height <= size.height;
+    }
+
+    int map_stones(Frame& frame, const std::vector<cv::Vec3f>& stones, gomokuai::PIECE_TYPE type)
+    {
+        int chess_count = 0;
+        for (const auto& stone: stones)
+        {
+            cv::Vec2f pos(stone[0], stone[1]);
+            pos -= frame.origin;
+            float inner = pos.dot(frame.dx);
+            int x = inner / frame.dx.dot(frame.dx) + 0.5f;
+            inner = pos.dot(frame.dy);
+            int y = inner / frame.dy.dot(frame.dy) + 0.5f;
+            if (x >= 0 && x <= 10 && y >= 0 && y <= 10)
+            {
+                frame.board[x * config::board_size + y] = type;
+                chess_count++;
+            }
+        }
+        return chess_count;
+    }
+
+    void assemble_board(Frame& frame)
+    {
+        frame.valid = false;
+        frame.board.fill(gomokuai::EMPTY);
+        frame.black_count = 0;
+        frame.white_count = 0;
+        if (frame.anchor_circle.size() != 1 || frame.anchor_circles.size() != 4)
+        {
+            return;
+        }
+        std::pair<float, cv::Vec2f> dists[4];
+        cv::Vec2f main_anchor(frame.anchor_circle[0][0], frame.anchor_circle[0][1]);
+        for (int i = 0; i < 4; i++)
+        {
+            cv::Vec2f anchor(frame.anchor_circles[i][0], frame.anchor_circles[i][1]);
+            dists[i] = {(main_anchor - anchor).dot(main_anchor - anchor), anchor};
+        }
+        std::sort(dists, dists + 4, [](const std::pair<float, cv::Vec2f>& x, const std::pair<float, cv::Vec2f>& y){ return x.first < y.first; });
+        frame.dx = (dists[1].second - dists[0].second)/8;
+        frame.dy = (dists[2].second - dists[0].second)/12;
+        frame.origin = dists[0].second - frame.dx + frame.dy;
+        frame.valid = true;
+
+        frame.black_count = map_stones(frame, frame.black, gomokuai::BLACK);
+        frame.white_count = map_stones(frame, frame.white, gomokuai::WHITE);
+    }
+}
\ No newline at end of file
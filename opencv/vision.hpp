@@ -0,0 +1,417 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <filesystem>
+#include <opencv2/opencv.hpp>
+
+#include "../logger.hpp"
+#include "../spsc_queue.hpp"
+#include "../ai/gomokuai.hpp"
+
+namespace opencv
+{
+    // 颜色分割的阈值, 定位点为 BGR 范围, 棋子为 HSV 的 V 与 S 阈值
+    struct ColourThresholds
+    {
+        uchar anchor_low[3] = {159, 95, 0};
+        uchar anchor_high[3] = {255, 223, 127};
+        uchar main_anchor_low[3] = {159, 159, 0};
+        uchar main_anchor_high[3] = {255, 255, 127};
+        // V <= black_max_value 为黑子
+        uchar black_max_value = 95;
+        // V >= white_min_value 且 S <= white_max_saturation 为白子
+        uchar white_min_value = 191;
+        uchar white_max_saturation = 63;
+    };
+
+    struct HoughParams
+    {
+        double min_dist, param1, param2;
+        int min_radius, max_radius;
+    };
+
+    // 识别用到的全部可调参数, 默认值为手工调出的参数, 相机 init() 时从配置文件加载
+    struct VisionParams
+    {
+        ColourThresholds colour;
+        HoughParams anchor_hough{500, 300, 15, 60, 80};
+        HoughParams stone_hough{100, 50, 20, 50, 70};
+        // 圆的外接正方形中颜色掩膜的像素数与半径平方之比超过该值时判定为该颜色的棋子
+        double stone_fill_ratio = 2.8;
+    };
+
+    bool load_vision_params(const string& path, VisionParams& params);
+
+    bool save_vision_params(const string& path, const VisionParams& params);
+
+    // 单次遍历 BGR 图像, 同时得到两个定位点掩膜, 灰度图和黑白棋子掩膜
+    // 输出需已按输入大小分配, 按行分块多线程处理
+    void segment(
+        const cv::Mat& img, const ColourThresholds& thresholds,
+        cv::Mat& anchor, cv::Mat& main_anchor, cv::Mat& grey, cv::Mat& black, cv::Mat& white
+    );
+
+    // 帧在流水线中经过的各个时间点
+    enum FRAME_STAGE
+    {
+        CAPTURE_BEGIN,
+        CAPTURED,
+        PREPROCESSED,
+        ANCHORS_DETECTED,
+        STONES_DETECTED,
+        ASSEMBLED,
+
+        STAGE_COUNT,
+    };
+
+    // 流水线中流转的一帧及其各阶段的中间结果
+    struct Frame
+    {
+        unsigned generation = 0;
+        // 自流水线启动以来的采集序号
+        unsigned long sequence = 0;
+        // 来源为录制文件时该帧在文件中的下标, 否则为 -1
+        long source_index = -1;
+        // 来源已读完或流水线被中断, 这一帧没有图像, 只用于通知消费者
+        bool end_of_source = false;
+        // 为 false 时只采集, 不做任何识别
+        bool full = true;
+        std::chrono::steady_clock::time_point timestamps[STAGE_COUNT];
+
+        cv::Mat img;
+        cv::Mat anchor_raw, anchor_mask, main_anchor_raw, main_anchor_mask;
+        cv::Mat grey_raw, grey, mask_black, mask_white;
+
+        std::vector<cv::Vec3f> anchor_circles, anchor_circle;
+        std::vector<cv::Vec3f> circles, black, white;
+
+        // 定位点是否完整, 以及由定位点得到的棋盘网格
+        bool valid = false;
+        cv::Vec2f origin, dx, dy;
+
+        gomokuai::Board board{};
+        int black_count = 0;
+        int white_count = 0;
+
+        void stamp(FRAME_STAGE stage)
+        {
+            timestamps[stage] = std::chrono::steady_clock::now();
+        }
+
+        // 清除上一次识别留下的结果
+        void clear_detection();
+
+        // 按分辨率预先分配全部缓冲区
+        void allocate(cv::Size size);
+
+        // 检查处理过程中是否有缓冲区被重新分配, 返回重新分配的个数
+        int check_buffers();
+    private:
+        std::array<const void*, 14> buffer_addresses{};
+
+        std::array<const void*, 14> get_buffer_addresses() const;
+    };
+
+    // 流水线的图像来源: 读出一帧写入 frame.img, 返回 false 表示读取失败, 稍后重试
+    // 来源读完时置 frame.end_of_source 并返回 true
+    using FrameSource = std::function<bool(Frame&)>;
+
+    // 一帧的检测结果, 用于绘制调试图层
+    struct Detection
+    {
+        bool valid = false;
+        cv::Vec2f origin, dx, dy;
+        std::vector<cv::Vec3f> anchor_circles, anchor_circle;
+        std::vector<cv::Vec3f> circles, black, white;
+
+        void assign(const Frame&);
+
+        void clear();
+
+        // 把检测结果按 scale 缩放后画到 img 上
+        void draw(cv::Mat& img, float scale) const;
+    };
+
+    // 视觉流水线的全部工作缓冲区, 在相机 init() 中按分辨率一次性分配, 之后每帧复用
+    struct VisionWorkspace
+    {
+        Frame frames[config::vision_pipeline_depth];
+
+        // 稳态下应始终为 0
+        std::atomic<int> reallocations = 0;
+
+        void allocate(cv::Size size);
+    };
+
+    // 窗口可见时把缩小后的帧与检测结果交给预览线程, 不会阻塞调用者
+    void publish_preview(const Frame&);
+
+    void publish_preview(const cv::Mat&);
+
+    void preview_start();
+
+    void preview_stop();
+
+    // 生成一帧随机局面的模拟相机图像, 包含透视, 模糊, 噪声和光照变化, truth 为对应的棋盘
+    // resolution_scale 为相对 3000x2000 的分辨率, 棋盘和棋子的大小随之缩放
+    void generate_synthetic_frame(cv::RNG& rng, cv::Mat& frame, gomokuai::Board& truth, float resolution_scale = 1);
+
+    cv::Size synthetic_frame_size(float resolution_scale);
+
+    // 毫秒耗时的分位数摘要, 会对 samples 排序
+    string summarise(std::vector<double>& samples);
+
+    // 交叉点周围边长为网格间距 0.6 倍的正方形, 落子时完全落在棋子内部
+    // 超出图像范围时返回 false
+    bool cell_patch(
+        const cv::Vec2f& origin, const cv::Vec2f& dx, const cv::Vec2f& dy,
+        int row, int col, const cv::Size& size, cv::Rect& rect
+    );
+
+    // 已确认的棋盘及其所在帧, 作为增量识别的参考
+    class IncrementalReference
+    {
+    public:
+        // frame 未经完整识别时沿用之前的网格
+        void set(const Frame& frame, const gomokuai::Board& board);
+
+        void clear();
+
+        // 由日志恢复的棋盘和网格, 没有参考帧; 下次识别时只对空位逐格分类, 不做整盘识别
+        void restore(const gomokuai::Board& board, cv::Vec2f origin, cv::Vec2f dx, cv::Vec2f dy);
+
+        bool known() const
+        {
+            return reference_known;
+        }
+
+        const gomokuai::Board& board() const
+        {
+            return stones;
+        }
+
+        // 最近一次完整识别得到的网格
+        bool grid(cv::Vec2f& origin, cv::Vec2f& dx, cv::Vec2f& dy) const;
+
+        // 只检查与参考帧相比发生变化的交叉点, 变化恰好为预期的新棋子时返回 true
+        // 没有参考帧时检查全部空位
+        // board 为参考棋盘加上新棋子
+        bool detect_changes(const Frame& frame, const VisionParams& params, int new_black, int new_white, gomokuai::Board& board);
+
+    private:
+        cv::Mat reference_img;
+        gomokuai::Board stones{};
+        cv::Vec2f origin, dx, dy;
+        bool geometry_known = false;
+        bool reference_known = false;
+
+        cv::Mat patch_anchor, patch_main_anchor, patch_grey, patch_black, patch_white;
+
+        gomokuai::PIECE_TYPE classify_patch(const cv::Mat& patch, const VisionParams& params);
+    };
+
+    struct ArchiveSlot;
+
+    // 把落子所依据的帧按比例缩小后交给后台线程, 连同调试图层和棋盘一起存档
+    // 超出磁盘预算时删除目录中最早的存档
+    class Archive
+    {
+    public:
+        Archive(const Logger& logger, const string& directory);
+
+        ~Archive();
+
+        void start();
+
+        void stop();
+
+        // 队列已满时直接丢弃, 不阻塞调用者; 调用者只付出复制一帧的时间
+        // frame 未经完整识别时使用 reference 的网格
+        void move(const Frame& frame, const IncrementalReference& reference, const gomokuai::Board& board, int move_number, gomokuai::Coord_2D move);
+
+    private:
+        static constexpr std::size_t depth = 3;
+
+        const Logger& logger;
+        const std::filesystem::path directory;
+
+        std::unique_ptr<ArchiveSlot[]> slots;
+        SpscQueue<ArchiveSlot*, 4> free_slots, pending;
+
+        std::thread thread;
+        bool is_archiving = false;
+        int dropped = 0;
+
+        // 已写入的存档文件, 按时间先后排列
+        std::deque<std::pair<std::filesystem::path, std::uintmax_t>> archived_files;
+        std::uintmax_t archived_bytes = 0;
+
+        void add_archived_file(const std::filesystem::path& path);
+        void enforce_disk_budget();
+        void scan_directory();
+        void write(ArchiveSlot& slot, std::vector<uchar>& buf);
+        void run();
+    };
+
+    // 按顺序读出录制文件中的帧, 跳过无法解码的帧, 读完后一直重复最后一帧, 文件无效时返回空函数
+    FrameSource recording_source(const char* path);
+
+    struct RecordSlot;
+
+    // 把识别时处理的原始帧和最终棋盘录制到文件
+    class Recorder
+    {
+    public:
+        Recorder(const Logger& logger);
+
+        ~Recorder();
+
+        bool start(const string& path);
+
+        void stop();
+
+        bool active() const
+        {
+            return recording;
+        }
+
+        // 录制中时复制一帧, 录制线程忙不过来时丢弃
+        void frame(const cv::Mat&);
+
+        // 录制前面各帧对应的最终棋盘, 未在录制或正在停止录制时返回 false
+        bool board(const gomokuai::Board&);
+
+    private:
+        static constexpr std::size_t depth = 4;
+
+        const Logger& logger;
+        std::unique_ptr<RecordSlot[]> slots;
+        SpscQueue<RecordSlot*, 8> free_slots, pending;
+
+        // start() 和 stop() 在控制台线程调用, frame() 和 board() 在对局线程调用, 由 lock 互斥
+        // 两个队列因此始终只有录制线程和持有 lock 的一方在读写
+        std::mutex lock;
+        std::atomic<bool> stopping = false;
+        std::ofstream file;
+        std::thread thread;
+        std::atomic<bool> recording = false;
+        int dropped_frames = 0;
+
+        void run();
+    };
+
+    // 最近若干帧识别结果的逐格投票
+    class BoardConsensus
+    {
+        std::vector<gomokuai::Board> history;
+        int next = 0;
+        int count = 0;
+        std::array<std::array<int, 3>, config::board_size * config::board_size> votes{};
+    public:
+        BoardConsensus(int window);
+
+        void reset();
+
+        void add(const gomokuai::Board&);
+
+        // 窗口已满且每一格多数票占比都不低于 threshold 时返回 true
+        // 否则把置信度不足的格子写入 ambiguous
+        bool decide(float threshold, gomokuai::Board& result, std::vector<gomokuai::Coord_2D>& ambiguous) const;
+
+        // 当前窗口中所有格子多数票占比的最小值
+        float min_confidence() const;
+    };
+
+    // 颜色转换与掩膜
+    void preprocess(Frame&, const VisionParams&);
+
+    // 在定位点掩膜上检测定位点
+    void detect_anchors(Frame&, const VisionParams&);
+
+    // 在灰度图上检测圆并按颜色分类为黑白棋子
+    void detect_stones(Frame&, const VisionParams&);
+
+    // 由定位点建立网格, 把棋子映射到棋盘上
+    void assemble_board(Frame&);
+
+    // 采集 -> 预处理 -> (定位点检测 || 棋子检测与分类) -> 棋盘组装
+    // 相邻阶段之间用单生产者单消费者队列传递帧指针, nullptr 表示流水线退出
+    class Pipeline
+    {
+    public:
+        // 帧缓冲区和识别参数由调用者持有, 参数只在流水线暂停时修改
+        // preview 为 true 时把每一帧交给预览窗口
+        Pipeline(const Logger& logger, const string& station_name, VisionWorkspace& workspace, const VisionParams& params, bool preview);
+
+        ~Pipeline();
+
+        // 从 source 读取帧, 启动各阶段线程
+        void start(FrameSource source);
+
+        void stop();
+
+        // 丢弃之前的帧, 开始连续识别; full 为 false 时只采集原始帧
+        void resume(bool full = true);
+
+        // 停止采集新帧, 已在流水线中的帧仍会流出
+        void pause();
+
+        // 送出一帧 end_of_source 的结束帧, 唤醒在 next() 中等待的消费者, 之后暂停采集
+        // 相机读不出帧时也会送出; 没有消费者在等待时, 下次 resume() 后它作为旧帧被丢弃
+        void interrupt();
+
+        // 取出下一帧识别完成的结果, 用完后需要 release 归还
+        Frame* next();
+
+        void release(Frame*);
+
+    private:
+        static constexpr std::size_t queue_capacity = 8;
+        static_assert(queue_capacity > config::vision_pipeline_depth);
+
+        using FrameQueue = SpscQueue<Frame*, queue_capacity>;
+
+        const Logger& logger;
+        const string station_name;
+        VisionWorkspace& workspace;
+        const VisionParams& params;
+        const bool preview;
+
+        FrameQueue free_frames;
+        FrameQueue captured_frames;
+        FrameQueue anchor_frames, stone_frames;
+        FrameQueue anchor_done_frames, stone_done_frames;
+        FrameQueue board_frames;
+
+        FrameSource frame_source;
+        std::atomic<bool> capturing = false;
+        std::atomic<bool> stopping = false;
+        std::atomic<bool> interrupting = false;
+        std::atomic<unsigned> generation = 0;
+        std::atomic<bool> full_processing = true;
+        unsigned long sequence = 0;
+
+        std::thread stage_threads[5];
+        bool is_running = false;
+
+        void capture_stage();
+        void preprocess_stage();
+        void worker_stage(FrameQueue& in, FrameQueue& out, void (*work)(Frame&, const VisionParams&), FRAME_STAGE stage, const char* name);
+        void assemble_stage();
+    };
+
+    // 标定时采集的一帧及其真实棋盘
+    struct CalibrationSample
+    {
+        cv::Mat img;
+        gomokuai::Board truth;
+    };
+}
\ No newline at end of file
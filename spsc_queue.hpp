@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// 有界单生产者单消费者无锁队列
+template <typename T, std::size_t capacity>
+class SpscQueue
+{
+    static_assert(capacity > 0 && (capacity & (capacity - 1)) == 0, "SpscQueue capacity must be a power of two.");
+
+    T buffer[capacity]{};
+    alignas(64) std::atomic<std::size_t> head{0};
+    alignas(64) std::atomic<std::size_t> tail{0};
+public:
+    bool push(T value)
+    {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == capacity)
+        {
+            return false;
+        }
+        buffer[t % capacity] = std::move(value);
+        tail.store(t + 1, std::memory_order_release);
+        tail.notify_one();
+        return true;
+    }
+
+    bool pop(T& value)
+    {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        value = std::move(buffer[h % capacity]);
+        head.store(h + 1, std::memory_order_release);
+        head.notify_one();
+        return true;
+    }
+
+    // 队列为空时阻塞, 直到生产者放入新元素
+    void wait_pop(T& value)
+    {
+        while (!pop(value))
+        {
+            tail.wait(head.load(std::memory_order_relaxed), std::memory_order_acquire);
+        }
+    }
+
+    std::size_t size() const
+    {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+};
\ No newline at end of file
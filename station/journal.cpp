@@ -0,0 +1,453 @@
+#include "journal.hpp"
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../config.hpp"
+
+namespace station
+{
+    // 日志文件: 文件头之后是一串记录, 每条记录为 类型(1 字节) + 长度(4 字节) + 内容 + CRC32(4 字节)
+    // 末尾不完整或校验失败的记录是写到一半时崩溃留下的, 重放到它为止
+    const char journal_magic[8] = {'G', 'M', 'K', 'J', 'R', 'N', '0', '1'};
+
+    enum JOURNAL_RECORD : uint8_t
+    {
+        JOURNAL_CALIBRATION,
+        JOURNAL_GAME_START,
+        JOURNAL_KEY,
+        JOURNAL_TURN,
+        JOURNAL_GAME_END,
+        JOURNAL_PLACED,
+        JOURNAL_ENGINE,
+    };
+
+    struct CalibrationRecord
+    {
+        float kx, bx, ky, by;
+    };
+
+    struct GameStartRecord
+    {
+        int32_t ai_type;
+    };
+
+    struct TurnRecord
+    {
+        int32_t count;
+        gomokuai::Board board;
+        int32_t row, col;
+        int32_t has_grid;
+        float grid[6];
+    };
+
+    uint32_t crc32(const char* data, std::size_t length, uint32_t crc = 0)
+    {
+        static const auto table = []
+        {
+            std::array<uint32_t, 256> table;
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++)
+                {
+                    c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+                }
+                table[i] = c;
+            }
+            return table;
+        }();
+        crc = ~crc;
+        for (std::size_t i = 0; i < length; i++)
+        {
+            crc = table[(crc ^ (uint8_t)data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    void encode(std::vector<char>& out, uint8_t type, const void* data, uint32_t length)
+    {
+        std::size_t begin = out.size();
+        out.push_back(type);
+        out.insert(out.end(), (const char*)&length, (const char*)&length + sizeof(length));
+        out.insert(out.end(), (const char*)data, (const char*)data + length);
+        uint32_t crc = crc32(out.data() + begin, out.size() - begin);
+        out.insert(out.end(), (const char*)&crc, (const char*)&crc + sizeof(crc));
+    }
+
+    template<typename Record_t>
+    bool decode(const char* data, uint32_t length, Record_t& record)
+    {
+        if (length != sizeof(Record_t))
+        {
+            return false;
+        }
+        memcpy(&record, data, length);
+        return true;
+    }
+
+    // 重放与追加共用, 保证两者得到的状态相同
+    bool apply(JournalState& state, uint8_t type, const char* data, uint32_t length)
+    {
+        CalibrationRecord calibration;
+        GameStartRecord start;
+        TurnRecord turn;
+        gomokuai::EngineParams params;
+        switch (type)
+        {
+        case JOURNAL_CALIBRATION:
+            if (!decode(data, length, calibration))
+            {
+                return false;
+            }
+            state.calibrated = true;
+            state.kx = calibration.kx;
+            state.bx = calibration.bx;
+            state.ky = calibration.ky;
+            state.by = calibration.by;
+            return true;
+        case JOURNAL_GAME_START:
+            if (!decode(data, length, start))
+            {
+                return false;
+            }
+            state.in_game = true;
+            state.ai_type = (gomokuai::PIECE_TYPE)start.ai_type;
+            // 执黑的第一步没有按键
+            state.count = state.ai_type == gomokuai::WHITE;
+            state.awaiting_key = state.ai_type == gomokuai::WHITE;
+            state.has_params = false;
+            state.has_turn = false;
+            state.placed = false;
+            state.has_grid = false;
+            return true;
+        case JOURNAL_ENGINE:
+            if (!decode(data, length, params))
+            {
+                return false;
+            }
+            state.has_params = true;
+            state.params = params;
+            return true;
+        case JOURNAL_KEY:
+            state.awaiting_key = false;
+            return length == 0;
+        case JOURNAL_TURN:
+            if (!decode(data, length, turn))
+            {
+                return false;
+            }
+            state.count = turn.count;
+            state.awaiting_key = false;
+            state.has_turn = true;
+            state.placed = false;
+            state.board = turn.board;
+            state.move = {turn.row, turn.col};
+            state.has_grid = turn.has_grid;
+            state.origin = {turn.grid[0], turn.grid[1]};
+            state.dx = {turn.grid[2], turn.grid[3]};
+            state.dy = {turn.grid[4], turn.grid[5]};
+            return true;
+        case JOURNAL_PLACED:
+            if (state.has_turn && !state.placed)
+            {
+                state.count += 2;
+                state.placed = true;
+                state.awaiting_key = true;
+            }
+            return length == 0;
+        case JOURNAL_GAME_END:
+            state.in_game = false;
+            return length == 0;
+        default:
+            return false;
+        }
+    }
+
+    TurnRecord make_turn(int count, const gomokuai::Board& board, gomokuai::Coord_2D move, bool has_grid, cv::Vec2f origin, cv::Vec2f dx, cv::Vec2f dy)
+    {
+        return {count, board, move.row, move.col, has_grid, {origin[0], origin[1], dx[0], dx[1], dy[0], dy[1]}};
+    }
+
+    // 只保留恢复当前状态所需的记录, 边写边重放, 最后按需补上按键
+    void compact(const JournalState& state, std::vector<char>& out)
+    {
+        JournalState rebuilt;
+        auto emit = [&](uint8_t type, const void* data, uint32_t length)
+        {
+            encode(out, type, data, length);
+            apply(rebuilt, type, (const char*)data, length);
+        };
+        out.insert(out.end(), journal_magic, journal_magic + sizeof(journal_magic));
+        if (state.calibrated)
+        {
+            CalibrationRecord calibration{state.kx, state.bx, state.ky, state.by};
+            emit(JOURNAL_CALIBRATION, &calibration, sizeof(calibration));
+        }
+        if (!state.in_game)
+        {
+            return;
+        }
+        GameStartRecord start{state.ai_type};
+        emit(JOURNAL_GAME_START, &start, sizeof(start));
+        if (state.has_params)
+        {
+            emit(JOURNAL_ENGINE, &state.params, sizeof(state.params));
+        }
+        if (state.has_turn)
+        {
+            auto turn = make_turn(state.placed ? state.count - 2 : state.count, state.board, state.move, state.has_grid, state.origin, state.dx, state.dy);
+            emit(JOURNAL_TURN, &turn, sizeof(turn));
+            if (state.placed)
+            {
+                emit(JOURNAL_PLACED, nullptr, 0);
+            }
+        }
+        if (rebuilt.awaiting_key && !state.awaiting_key)
+        {
+            emit(JOURNAL_KEY, nullptr, 0);
+        }
+    }
+
+    bool write_all(int fd, const char* data, std::size_t length)
+    {
+        while (length > 0)
+        {
+            ssize_t written = ::write(fd, data, length);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            data += written;
+            length -= written;
+        }
+        return true;
+    }
+
+    Journal::Journal(const Logger& logger, const string& path):
+        logger(logger),
+        path(path)
+    {}
+
+    Journal::~Journal()
+    {
+        close();
+    }
+
+    bool Journal::open()
+    {
+        close();
+        JournalState state;
+        std::ifstream file(path, std::ios::binary);
+        std::vector<char> content{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+        std::size_t records = 0;
+        if (content.size() >= sizeof(journal_magic) && memcmp(content.data(), journal_magic, sizeof(journal_magic)) == 0)
+        {
+            std::size_t offset = sizeof(journal_magic);
+            while (offset + 5 + 4 <= content.size())
+            {
+                uint8_t type = content[offset];
+                uint32_t length, crc;
+                memcpy(&length, &content[offset + 1], sizeof(length));
+                if (length > content.size() - offset - 9)
+                {
+                    break;
+                }
+                memcpy(&crc, &content[offset + 5 + length], sizeof(crc));
+                if (crc != crc32(&content[offset], 5 + length) || !apply(state, type, &content[offset + 5], length))
+                {
+                    break;
+                }
+                offset += 9 + length;
+                records++;
+            }
+            if (offset != content.size())
+            {
+                logger.warn("Journal {} has {} bytes of torn or corrupted records at the end, ignored.", path, content.size() - offset);
+            }
+        }
+        else if (!content.empty())
+        {
+            logger.error("{} is not a journal.", path);
+            return false;
+        }
+
+        // 先写临时文件再改名, 压缩时崩溃也不会丢失原来的日志
+        std::vector<char> compacted;
+        compact(state, compacted);
+        string temp_path = path + ".tmp";
+        int temp_fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (temp_fd < 0 || !write_all(temp_fd, compacted.data(), compacted.size()) || fdatasync(temp_fd) != 0)
+        {
+            logger.error("Cannot write journal {}.", temp_path);
+            if (temp_fd >= 0)
+            {
+                ::close(temp_fd);
+            }
+            return false;
+        }
+        ::close(temp_fd);
+        std::error_code error;
+        std::filesystem::rename(temp_path, path, error);
+        if (error)
+        {
+            logger.error("Cannot replace {}: {}", path, error.message());
+            return false;
+        }
+        fd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+        if (fd < 0)
+        {
+            logger.error("Cannot open journal {}.", path);
+            return false;
+        }
+
+        current = state;
+        pending.clear();
+        appended = durable = 0;
+        failed = urgent = stopping = false;
+        writer = std::thread(&Journal::run, this);
+        if (records > 0)
+        {
+            logger.info(
+                "Replayed {} journal records from {}{}.", records, path,
+                state.in_game ? format(", game in progress at {} stones", state.count) : ""
+            );
+        }
+        return true;
+    }
+
+    void Journal::close()
+    {
+        if (!writer.joinable())
+        {
+            return;
+        }
+        {
+            auto guard = std::lock_guard(lock);
+            stopping = true;
+        }
+        wake_cond.notify_one();
+        writer.join();
+        ::close(fd);
+        fd = -1;
+    }
+
+    JournalState Journal::state()
+    {
+        auto guard = std::lock_guard(lock);
+        return current;
+    }
+
+    void Journal::append(uint8_t type, const void* data, uint32_t length)
+    {
+        apply(current, type, (const char*)data, length);
+        if (!writer.joinable())
+        {
+            return;
+        }
+        encode(pending, type, data, length);
+        appended++;
+        wake_cond.notify_one();
+    }
+
+    void Journal::calibration(float kx, float bx, float ky, float by)
+    {
+        CalibrationRecord record{kx, bx, ky, by};
+        auto guard = std::lock_guard(lock);
+        append(JOURNAL_CALIBRATION, &record, sizeof(record));
+    }
+
+    void Journal::game_start(gomokuai::PIECE_TYPE ai_type, const gomokuai::EngineParams& params)
+    {
+        GameStartRecord record{ai_type};
+        auto guard = std::lock_guard(lock);
+        append(JOURNAL_GAME_START, &record, sizeof(record));
+        append(JOURNAL_ENGINE, &params, sizeof(params));
+    }
+
+    void Journal::key()
+    {
+        auto guard = std::lock_guard(lock);
+        append(JOURNAL_KEY, nullptr, 0);
+    }
+
+    void Journal::turn(int count, const gomokuai::Board& board, gomokuai::Coord_2D move, bool has_grid, cv::Vec2f origin, cv::Vec2f dx, cv::Vec2f dy)
+    {
+        auto record = make_turn(count, board, move, has_grid, origin, dx, dy);
+        auto guard = std::lock_guard(lock);
+        append(JOURNAL_TURN, &record, sizeof(record));
+    }
+
+    void Journal::placed()
+    {
+        auto guard = std::lock_guard(lock);
+        append(JOURNAL_PLACED, nullptr, 0);
+    }
+
+    void Journal::game_end()
+    {
+        auto guard = std::lock_guard(lock);
+        append(JOURNAL_GAME_END, nullptr, 0);
+    }
+
+    bool Journal::sync()
+    {
+        auto guard = std::unique_lock(lock);
+        uint64_t target = appended;
+        urgent = true;
+        wake_cond.notify_one();
+        synced_cond.wait(guard, [&]{ return durable >= target || failed || !writer.joinable(); });
+        return durable >= target;
+    }
+
+    void Journal::run()
+    {
+        std::vector<char> batch;
+        auto guard = std::unique_lock(lock);
+        while (true)
+        {
+            wake_cond.wait(guard, [&]{ return !pending.empty() || stopping; });
+            if (pending.empty())
+            {
+                return;
+            }
+            // 攒一小段时间的记录一起写入, 有人等待时立即写入
+            wake_cond.wait_for(guard, config::journal_sync_interval, [&]{ return urgent || stopping; });
+            batch.swap(pending);
+            uint64_t written = appended;
+            urgent = false;
+            if (failed)
+            {
+                batch.clear();
+                continue;
+            }
+            guard.unlock();
+
+            bool ok = write_all(fd, batch.data(), batch.size()) && fdatasync(fd) == 0;
+            int error = ok ? 0 : errno;
+            batch.clear();
+
+            guard.lock();
+            if (ok)
+            {
+                durable = written;
+            }
+            else
+            {
+                logger.error("Cannot write journal {}: {}, no further records will be written.", path, strerror(error));
+                failed = true;
+            }
+            synced_cond.notify_all();
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <opencv2/opencv.hpp>
+
+#include "../logger.hpp"
+#include "../ai/gomokuai.hpp"
+
+namespace station
+{
+    // 由日志重放得到的工位状态
+    struct JournalState
+    {
+        bool calibrated = false;
+        float kx = 1, bx = 0, ky = 1, by = 0;
+
+        // 有未结束的对局, 以及对局开始时的估值参数
+        bool in_game = false;
+        gomokuai::PIECE_TYPE ai_type = gomokuai::BLACK;
+        bool has_params = false;
+        gomokuai::EngineParams params;
+        // 下一次识别时棋盘上应有的棋子数, 以及识别前是否还要等对手按键
+        int count = 0;
+        bool awaiting_key = false;
+
+        // 最近一步识别出的棋盘 (不含 AI 这一步), AI 的落子点, 以及识别所用的网格
+        // placed 为 false 时这一步还没有确认放下, 恢复后重新识别这一步
+        bool has_turn = false;
+        bool placed = false;
+        gomokuai::Board board{};
+        gomokuai::Coord_2D move;
+        bool has_grid = false;
+        cv::Vec2f origin, dx, dy;
+    };
+
+    // 只追加的二进制日志, 记录标定, 对局开始与结束, 按键, 每一步的决定和放下, 进程崩溃后重放即可恢复对局
+    // 记录先放入内存, 由后台线程攒一小段时间后一起写入并 fdatasync
+    class Journal
+    {
+    public:
+        Journal(const Logger& logger, const string& path);
+
+        ~Journal();
+
+        // 重放已有的日志, 再把当前状态压缩写成新文件, 之后在其后追加
+        bool open();
+
+        // 写完已追加的记录后关闭
+        void close();
+
+        // 已追加的全部记录对应的状态
+        JournalState state();
+
+        void calibration(float kx, float bx, float ky, float by);
+
+        void game_start(gomokuai::PIECE_TYPE ai_type, const gomokuai::EngineParams& params);
+
+        void key();
+
+        // AI 决定的落子点, 还没有放下
+        void turn(int count, const gomokuai::Board& board, gomokuai::Coord_2D move, bool has_grid, cv::Vec2f origin, cv::Vec2f dx, cv::Vec2f dy);
+
+        // 机械臂已把 turn() 中的棋子放下
+        void placed();
+
+        void game_end();
+
+        // 等待已追加的记录写入磁盘, 有记录写入失败时返回 false
+        bool sync();
+
+    private:
+        const Logger& logger;
+        const string path;
+
+        std::mutex lock;
+        std::condition_variable wake_cond, synced_cond;
+        JournalState current;
+        std::vector<char> pending;
+        uint64_t appended = 0, durable = 0;
+        // 写入失败后文件末尾可能残留半条记录, 之后不再写入, 直到重新 open()
+        bool failed = false;
+        bool urgent = false;
+        bool stopping = false;
+
+        int fd = -1;
+        std::thread writer;
+
+        // 调用时已持有 lock
+        void append(uint8_t type, const void* data, uint32_t length);
+        void run();
+    };
+}
\ No newline at end of file
@@ -0,0 +1,417 @@
+#include "station.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <optional>
+#include <future>
+
+#include "../ai/pool.hpp"
+#include "../tracing.hpp"
+#include "../metrics.hpp"
+#include "../config.hpp"
+
+namespace station
+{
+    static Logger logger("Station");
+
+    // 各工位的指标汇总在一起
+    metrics::Counter& turns_played = metrics::counter("gomoku_turns_total", "Moves placed by the robot");
+    metrics::Gauge& stones_on_board = metrics::gauge("gomoku_stones_on_board", "Stones on the board after the last move");
+    metrics::Histogram& arm_cycle_time = metrics::histogram(
+        "gomoku_arm_cycle_seconds", "Time from the AI decision until the arm finished placing and then fetching the next stone or parking", metrics::exponential_buckets(0.25, 1.5, 12)
+    );
+    metrics::Histogram& key_to_placed_latency = metrics::histogram(
+        "gomoku_key_to_placed_seconds", "Time from the opponent's key press until the stone was placed", metrics::exponential_buckets(0.25, 1.5, 14)
+    );
+
+    // 设备名和序列号只含 ASCII 字符
+    std::wstring widen(const string& str)
+    {
+        return std::wstring(str.begin(), str.end());
+    }
+
+    std::vector<Settings> load_settings(const string& path)
+    {
+        std::vector<Settings> stations;
+        std::ifstream file(path);
+        if (!file)
+        {
+            logger.info("{} not found, using a single station with the default settings.", path);
+            stations.emplace_back();
+            return stations;
+        }
+        string line;
+        int line_number = 0;
+        while (std::getline(file, line))
+        {
+            line_number++;
+            line = line.substr(0, line.find('#'));
+            std::istringstream is(line);
+            string key, value;
+            if (!(is >> key))
+            {
+                continue;
+            }
+            is >> value;
+            if (key == "station")
+            {
+                auto& settings = stations.emplace_back();
+                settings.name = value;
+                settings.camera.archive_directory = format("{}/{}", config::archive_directory, value);
+                settings.journal_file = format("{}.journal", value);
+                settings.coefs_file = format("{}.coefs", value);
+                continue;
+            }
+            if (stations.empty())
+            {
+                logger.error("{}:{}: {} before the first station.", path, line_number, key);
+                continue;
+            }
+            auto& settings = stations.back();
+            if (key == "video") settings.camera.video_device_id = atoi(value.c_str());
+            else if (key == "hid") settings.device.name = widen(value);
+            else if (key == "serial") settings.device.serial = widen(value);
+            else if (key == "profile") settings.camera.vision_profile = value;
+            else if (key == "coefs") settings.coefs_file = value;
+            else if (key == "journal") settings.journal_file = value;
+            else if (key == "archive") settings.camera.archive_directory = value;
+            else if (key == "recording") settings.camera.recording = value;
+            else if (key == "side") settings.ai_type = value == "white" ? gomokuai::WHITE : gomokuai::BLACK;
+            else if (key == "simulate")
+            {
+                settings.device.simulated = true;
+                settings.device.key_script = value;
+            }
+            else
+            {
+                logger.warn("{}:{}: unknown key {}.", path, line_number, key);
+            }
+        }
+        if (stations.empty())
+        {
+            logger.warn("No station in {}, using the default settings.", path);
+            stations.emplace_back();
+        }
+        // 预览窗口只有一个, 给第一个工位
+        for (std::size_t i = 1; i < stations.size(); i++)
+        {
+            stations[i].camera.preview = false;
+        }
+        // 没有序列号的工位各自打开一台尚未被占用的同名设备, 哪台归哪个工位取决于枚举顺序
+        auto without_serial = std::count_if(stations.begin(), stations.end(), [](const Settings& settings)
+        {
+            return !settings.device.simulated && settings.device.serial.empty();
+        });
+        if (without_serial > 1)
+        {
+            logger.warn("{} stations have no HID serial configured, their boards may be swapped.", without_serial);
+        }
+        return stations;
+    }
+
+    Station::Station(const Settings& settings):
+        settings(settings),
+        device(settings.name, settings.device),
+        camera(settings.name, settings.camera),
+        planner(settings.name, device),
+        logger(instance_name("Station", settings.name)),
+        journal(logger, settings.journal_file)
+    {}
+
+    Station::~Station()
+    {
+        exit();
+    }
+
+    long long elapsed_ms(std::chrono::steady_clock::time_point since)
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - since).count();
+    }
+
+    bool Station::init()
+    {
+        auto begin = std::chrono::steady_clock::now();
+        // 下位机的枚举和相机的打开与预热互不相关, 同时进行
+        auto device_ready = std::async(std::launch::async, [&]
+        {
+            bool ready = device.init();
+            logger.info("Device {} after {} ms.", ready ? "ready" : "failed", elapsed_ms(begin));
+            return ready;
+        });
+        bool journal_ready = journal.open();
+        auto state = journal.state();
+        if (state.calibrated)
+        {
+            planner.set_calibration(state.kx, state.bx, state.ky, state.by);
+        }
+        bool camera_ready = camera.init();
+        logger.info("Camera {} after {} ms.", camera_ready ? "ready" : "failed", elapsed_ms(begin));
+        // 恢复的棋盘代替参考帧, 继续对局时不必整盘识别
+        if (state.in_game && state.has_turn && state.has_grid)
+        {
+            camera.restore(state.board, state.origin, state.dx, state.dy);
+        }
+        bool ready = device_ready.get() && camera_ready && journal_ready;
+        if (ready)
+        {
+            logger.info("Station ready after {} ms.", elapsed_ms(begin));
+        }
+        return ready;
+    }
+
+    void Station::exit()
+    {
+        stop();
+        journal.close();
+        // 等待接收线程和流水线各线程退出, 同样同时进行
+        auto device_closed = std::async(std::launch::async, [&]{ device.exit(); });
+        camera.exit();
+        device_closed.get();
+    }
+
+    bool Station::restart()
+    {
+        auto begin = std::chrono::steady_clock::now();
+        exit();
+        bool ready = init();
+        logger.info("Restart {} after {} ms.", ready ? "finished" : "failed", elapsed_ms(begin));
+        return ready;
+    }
+
+    void Station::start()
+    {
+        if (playing)
+        {
+            return;
+        }
+        // 下棋线程因故障自行结束时在这里回收
+        if (player.joinable())
+        {
+            player.join();
+        }
+        playing = true;
+        player = std::thread(&Station::play, this);
+    }
+
+    void Station::stop()
+    {
+        if (!player.joinable())
+        {
+            return;
+        }
+        // 下棋线程可能在等按键, 也可能在识别棋盘
+        camera.interrupt_recognition();
+        device.interrupt_key_wait();
+        player.join();
+        // 下棋线程可能没有走到等按键或识别就已结束, 中断不能留给下一局
+        camera.clear_interrupt();
+        device.clear_key_interrupt();
+        playing = false;
+    }
+
+    void Station::set_calibration(float kx, float bx, float ky, float by)
+    {
+        planner.set_calibration(kx, bx, ky, by);
+        journal.calibration(kx, bx, ky, by);
+        journal.sync();
+    }
+
+    void Station::end_game()
+    {
+        if (journal.state().in_game)
+        {
+            journal.game_end();
+            journal.sync();
+            logger.info("Game ended.");
+        }
+    }
+
+    void Station::play()
+    {
+        tracing::set_thread_name(instance_name("player", settings.name).c_str());
+        auto game = journal.state();
+        // 未确认放下的一步可能其实已经放下 (放下后, PLACED 写入磁盘前崩溃, 或放下后才报告失败)
+        // 重新识别时, 日志中的棋盘加上这一步也接受, 视为已放下
+        std::optional<gomokuai::Board> unconfirmed;
+        if (game.in_game)
+        {
+            logger.info("Resuming the game at {} stones.", game.count);
+            if (game.has_turn && !game.placed)
+            {
+                logger.warn("Move to {}, {} was not confirmed as placed, recognising the board again.", game.move.row, game.move.col);
+                unconfirmed = game.board;
+                (*unconfirmed)[game.move.row * config::board_size + game.move.col] = game.ai_type;
+            }
+        }
+        else
+        {
+            journal.game_start(settings.ai_type, gomokuai::get_params());
+            game = journal.state();
+        }
+        // 继续的对局沿用日志中的执子颜色和估值参数
+        auto ai_type = game.ai_type;
+        auto params = game.has_params ? game.params : gomokuai::get_params();
+        if (params != gomokuai::get_params())
+        {
+            logger.info("Continuing with the engine parameters the game started with.");
+        }
+        int count = game.count;
+        gomokuai::Coord_2D centre(config::board_size / 2, config::board_size / 2);
+        planner.reset(settings.idle_point);
+        // 预取模式下落子后立即吸起下一颗棋子, AI 决定后只剩移动到目标点和放下
+        bool holding_stone = false;
+        // 有规划失败后吸泵是否开着, 手上有没有棋子都已不可知, 停止对局, 不再发出吸泵命令
+        bool arm_failed = false;
+        if (config::prefetch_stone)
+        {
+            auto fetch = planner.execute(planner.plan_fetch(centre, planner.choose_hover(centre)));
+            holding_stone = planner.finish(fetch);
+            arm_failed = !holding_stone;
+            if (arm_failed)
+            {
+                logger.error("Fetching the first stone failed, not starting the game.");
+            }
+        }
+        bool running = !arm_failed;
+        // 执黑的第一步没有按键
+        bool key_pressed = false;
+        if (running && game.awaiting_key)
+        {
+            running = key_pressed = device.wait_for_next_key();
+            if (key_pressed)
+            {
+                journal.key();
+            }
+        }
+        while (running)
+        {
+            tracing::Span turn_span("turn", "player");
+            auto turn_begin = std::chrono::steady_clock::now();
+            // 不持有棋子时, 棋盘识别完成后 AI 思考的同时机械臂去取子
+            std::optional<motion::Execution> fetch;
+            // 按键后开始计时, 共用的 AI 线程池先处理等得最久的工位
+            auto on_clock_since = key_pressed ? device.last_key_time() : turn_begin;
+            bool already_placed = false;
+            auto think = [&](const gomokuai::Board& board)
+            {
+                if (unconfirmed && board == *unconfirmed)
+                {
+                    already_placed = true;
+                    return game.move;
+                }
+                auto point = gomokuai::think_async(board, ai_type, on_clock_since, params).get();
+                cv::Vec2f origin, dx, dy;
+                bool has_grid = camera.grid(origin, dx, dy);
+                journal.turn(count, board, point, has_grid, origin, dx, dy);
+                return point;
+            };
+            auto pos = camera.get_ai_step(count, think, [&]
+            {
+                // 取子后停在料槽, 落子时直接从料槽去落子点
+                if (!holding_stone)
+                {
+                    fetch = planner.execute(planner.plan_fetch(centre));
+                }
+            }, unconfirmed ? &*unconfirmed : nullptr);
+            unconfirmed.reset();
+            if (pos.row < 0)
+            {
+                break;
+            }
+            if (already_placed)
+            {
+                logger.info("Move to {}, {} is on the board, continuing after the opponent's move.", pos.row, pos.col);
+                journal.placed();
+                journal.sync();
+                if (fetch)
+                {
+                    holding_stone = planner.finish(*fetch);
+                    if (!holding_stone)
+                    {
+                        logger.error("Fetching a stone failed, stopping the game.");
+                        arm_failed = true;
+                        break;
+                    }
+                }
+                count += 2;
+                running = key_pressed = device.wait_for_next_key();
+                if (key_pressed)
+                {
+                    journal.key();
+                }
+                continue;
+            }
+            auto think_end = std::chrono::steady_clock::now();
+            LOG_TRACE(logger, "AI point: {}, {}.", pos.row, pos.col);
+            // 取子失败时不能再去落子; 取子此时多半已完成, 等它只多一次应答往返
+            if (fetch && !planner.finish(*fetch))
+            {
+                logger.error("Fetching a stone for {}, {} failed, stopping the game.", pos.row, pos.col);
+                arm_failed = true;
+                break;
+            }
+            auto place = planner.execute(planner.plan_place(pos));
+            // 下一步多半落在这一步附近, 预取时在离它最近的悬停点等待, 否则退到离它最近的停靠点
+            // 落子失败时下位机放弃排在后面的命令, 这里的取子不会执行
+            auto after = planner.execute(
+                config::prefetch_stone ? planner.plan_fetch(pos, planner.choose_hover(pos)) : planner.plan_park(planner.choose_park(pos))
+            );
+            if (planner.finish(place))
+            {
+                // 确认放下后才记为已落子, 机械臂继续移动的同时等待写入磁盘
+                journal.placed();
+                journal.sync();
+            }
+            else
+            {
+                // 日志中这一步仍未放下, 排除故障后重新开始即重新识别这一步
+                logger.error("Move to {}, {} was not completed, stopping the game.", pos.row, pos.col);
+                planner.finish(after);
+                arm_failed = true;
+                break;
+            }
+            auto placed = std::chrono::steady_clock::now();
+            turns_played.add();
+            stones_on_board.set(count + 1);
+            if (key_pressed)
+            {
+                key_to_placed_latency.observe(placed - device.last_key_time());
+            }
+            logger.info(
+                "Stone placed {} ms after the turn began, {} ms after the AI decided.",
+                std::chrono::duration_cast<std::chrono::milliseconds>(placed - turn_begin).count(),
+                std::chrono::duration_cast<std::chrono::milliseconds>(placed - think_end).count()
+            );
+            if (!planner.finish(after))
+            {
+                logger.error("{} after the move failed, stopping the game.", config::prefetch_stone ? "Fetching the next stone" : "Parking");
+                arm_failed = true;
+                break;
+            }
+            holding_stone = config::prefetch_stone;
+            // 包括落子后取下一颗棋子或退到停靠点, 机械臂此后空闲
+            arm_cycle_time.observe(std::chrono::steady_clock::now() - think_end);
+            count += 2;
+            tracing::Span key_span("wait for key", "player");
+            running = key_pressed = device.wait_for_next_key();
+            if (key_pressed)
+            {
+                journal.key();
+            }
+        }
+        // 停止时把预取的棋子放回料槽, 回到 idle_point; 出过故障时只移动, 由操作员检查吸泵和棋子
+        if (arm_failed)
+        {
+            logger.error("The arm state is unknown after the failure, check the pump and any held stone.");
+        }
+        else if (holding_stone)
+        {
+            logger.info("Returning the held stone.");
+        }
+        bool returning = holding_stone && !arm_failed;
+        auto rest = planner.execute(returning ? planner.plan_return(settings.idle_point) : planner.plan_park(settings.idle_point));
+        planner.finish(rest);
+        playing = false;
+    }
+}
\ No newline at end of file
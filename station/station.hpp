@@ -0,0 +1,84 @@
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <vector>
+
+#include "../logger.hpp"
+#include "../ai/gomokuai.hpp"
+#include "../opencv/opencv.hpp"
+#include "../hid/hid.hpp"
+#include "../motion/planner.hpp"
+#include "journal.hpp"
+
+namespace station
+{
+    // 一个工位的配置: 相机, 下位机, 标定文件和执子颜色
+    struct Settings
+    {
+        // 用于日志, 线程名和存档目录, 只有一个工位时可以为空
+        string name;
+        opencv::Camera::Options camera;
+        hid::Device::Options device;
+        // 配置文件中的工位默认为 <名字>.coefs 和 <名字>.journal
+        string coefs_file = "coefs.tmp";
+        string journal_file = config::journal_file;
+        gomokuai::PIECE_TYPE ai_type = gomokuai::BLACK;
+        gomokuai::Coord_2D idle_point{5, -4};
+    };
+
+    // 工位配置文件: 每行为 键 值, "station <名字>" 开始一个新工位, # 之后为注释
+    // 键: video, hid, serial, profile, coefs, journal, archive, side (black/white), simulate [按键脚本], recording
+    // 文件不存在时返回一个使用默认配置的工位
+    std::vector<Settings> load_settings(const string& path);
+
+    // 一套相机和机械臂, 在自己的线程中下一盘棋; 各工位共用 AI 线程池
+    class Station
+    {
+    public:
+        const Settings settings;
+        hid::Device device;
+        opencv::Camera camera;
+        motion::Planner planner;
+
+        Station(const Settings& settings);
+
+        ~Station();
+
+        Station(const Station&) = delete;
+        Station& operator=(const Station&) = delete;
+
+        // 下位机和相机同时初始化, 各自记录用时; 重放日志, 恢复标定和未结束对局的棋盘
+        bool init();
+
+        void exit();
+
+        // 故障后重新连接下位机, 重新打开相机, 正在下棋时先停下
+        bool restart();
+
+        // 开始下棋, 日志中有未结束的对局时接着下, 已在下棋时不做任何事
+        void start();
+
+        // 中断按键等待, 等下棋线程把棋子放回并停下
+        void stop();
+
+        bool is_playing() const
+        {
+            return playing;
+        }
+
+        // 设置机械臂标定并写入日志
+        void set_calibration(float kx, float bx, float ky, float by);
+
+        // 结束日志中的对局, 下次开始时是新的一盘
+        void end_game();
+
+    private:
+        Logger logger;
+        Journal journal;
+        std::thread player;
+        std::atomic<bool> playing = false;
+
+        void play();
+    };
+}
\ No newline at end of file
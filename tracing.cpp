@@ -0,0 +1,195 @@
+#include "tracing.hpp"
+
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <fstream>
+
+#include "logger.hpp"
+
+namespace tracing
+{
+    static Logger logger("Tracing");
+
+    std::atomic<bool> recording = false;
+
+    struct Event
+    {
+        const char* name;
+        const char* category;
+        char phase;
+        std::chrono::steady_clock::time_point time;
+        std::chrono::steady_clock::duration duration;
+        uint64_t id;
+    };
+
+    // 每个线程只向自己的缓冲区追加, 锁只在写出文件时才会有竞争
+    struct ThreadBuffer
+    {
+        std::mutex lock;
+        int tid;
+        std::string name;
+        std::vector<Event> events;
+    };
+
+    std::mutex registry_lock;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    std::string output_path;
+    std::chrono::steady_clock::time_point origin;
+
+    ThreadBuffer& thread_buffer()
+    {
+        thread_local std::shared_ptr<ThreadBuffer> buffer = []
+        {
+            auto buffer = std::make_shared<ThreadBuffer>();
+            auto guard = std::lock_guard(registry_lock);
+            buffer->tid = buffers.size() + 1;
+            buffer->name = format("thread {}", buffer->tid);
+            buffers.push_back(buffer);
+            return buffer;
+        }();
+        return *buffer;
+    }
+
+    void record(Event&& event)
+    {
+        auto& buffer = thread_buffer();
+        auto guard = std::lock_guard(buffer.lock);
+        buffer.events.push_back(event);
+    }
+
+    void set_thread_name(const char* name)
+    {
+        auto& buffer = thread_buffer();
+        auto guard = std::lock_guard(buffer.lock);
+        buffer.name = name;
+    }
+
+    void complete(const char* name, const char* category, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end)
+    {
+        if (enabled())
+        {
+            record({name, category, 'X', begin, end - begin, 0});
+        }
+    }
+
+    void instant(const char* name, const char* category)
+    {
+        if (enabled())
+        {
+            record({name, category, 'i', std::chrono::steady_clock::now(), {}, 0});
+        }
+    }
+
+    void async_begin(const char* name, const char* category, uint64_t id)
+    {
+        if (enabled())
+        {
+            record({name, category, 'b', std::chrono::steady_clock::now(), {}, id});
+        }
+    }
+
+    void async_end(const char* name, const char* category, uint64_t id)
+    {
+        if (enabled())
+        {
+            record({name, category, 'e', std::chrono::steady_clock::now(), {}, id});
+        }
+    }
+
+    void start(const std::string& path)
+    {
+        auto guard = std::lock_guard(registry_lock);
+        for (auto& buffer: buffers)
+        {
+            auto buffer_guard = std::lock_guard(buffer->lock);
+            buffer->events.clear();
+        }
+        output_path = path;
+        origin = std::chrono::steady_clock::now();
+        recording = true;
+        logger.info("Recording trace to {}.", path);
+    }
+
+    // 线程名含有配置文件中的工位名, 写入 JSON 的字符串都要转义
+    std::string json_escape(std::string_view text)
+    {
+        std::string escaped;
+        escaped.reserve(text.size());
+        for (char c: text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped.push_back('\\');
+                escaped.push_back(c);
+            }
+            else if ((unsigned char)c < 0x20)
+            {
+                const char hex[] = "0123456789abcdef";
+                escaped.append("\\u00");
+                escaped.push_back(hex[c >> 4]);
+                escaped.push_back(hex[c & 15]);
+            }
+            else
+            {
+                escaped.push_back(c);
+            }
+        }
+        return escaped;
+    }
+
+    double to_us(std::chrono::steady_clock::duration duration)
+    {
+        return std::chrono::duration<double, std::micro>(duration).count();
+    }
+
+    void stop()
+    {
+        if (!recording.exchange(false))
+        {
+            return;
+        }
+        std::ofstream file(output_path);
+        if (!file)
+        {
+            logger.error("Cannot write trace to {}.", output_path);
+            return;
+        }
+        std::size_t count = 0;
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GomokuRobot\"}}";
+        auto guard = std::lock_guard(registry_lock);
+        for (auto& buffer: buffers)
+        {
+            auto buffer_guard = std::lock_guard(buffer->lock);
+            file << format(
+                ",\n{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}",
+                buffer->tid, json_escape(buffer->name)
+            );
+            for (auto& event: buffer->events)
+            {
+                file << format(
+                    ",\n{{\"name\":\"{}\",\"cat\":\"{}\",\"ph\":\"{}\",\"pid\":1,\"tid\":{},\"ts\":{:.3f}",
+                    json_escape(event.name), json_escape(event.category), event.phase, buffer->tid, to_us(event.time - origin)
+                );
+                if (event.phase == 'X')
+                {
+                    file << format(",\"dur\":{:.3f}", to_us(event.duration));
+                }
+                else if (event.phase == 'i')
+                {
+                    file << ",\"s\":\"t\"";
+                }
+                else
+                {
+                    file << format(",\"id\":{}", event.id);
+                }
+                file << "}";
+            }
+            count += buffer->events.size();
+            buffer->events.clear();
+        }
+        file << "\n]}\n";
+        logger.info("Trace with {} events written to {}.", count, output_path);
+    }
+}
\ No newline at end of file
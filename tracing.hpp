@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// 以 Chrome Trace Event 格式记录时间线, 可在 Perfetto 或 chrome://tracing 中打开
+// 未开始记录时每个埋点只读取一次原子变量
+namespace tracing
+{
+    extern std::atomic<bool> recording;
+
+    inline bool enabled()
+    {
+        return recording.load(std::memory_order_relaxed);
+    }
+
+    // 开始记录, stop() 时写入 path
+    void start(const std::string& path);
+
+    void stop();
+
+    // 为当前线程命名, 在时间线中显示为一行
+    void set_thread_name(const char* name);
+
+    // 名称和类别须为字符串常量, 只保存指针
+    void complete(const char* name, const char* category, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end);
+
+    void instant(const char* name, const char* category);
+
+    // 可跨线程的异步事件, 以 id 配对开始与结束
+    void async_begin(const char* name, const char* category, uint64_t id);
+
+    void async_end(const char* name, const char* category, uint64_t id);
+
+    // 作用域结束时记录一段完整事件
+    class Span
+    {
+        const char* name;
+        const char* category;
+        std::chrono::steady_clock::time_point begin;
+        bool active;
+
+    public:
+        Span(const char* name, const char* category):
+            name(name),
+            category(category),
+            active(enabled())
+        {
+            if (active)
+            {
+                begin = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~Span()
+        {
+            if (active)
+            {
+                complete(name, category, begin, std::chrono::steady_clock::now());
+            }
+        }
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+
+// 单写单读的无锁缓冲交换: 写端和读端各持有一个缓冲区, 第三个缓冲区用于交换
+// 写端发布后立即拿到另一个空闲缓冲区, 读端只在有新数据时切换, 双方都不会等待对方
+template <typename T>
+class TripleBuffer
+{
+    // 低两位为交换缓冲区的下标, dirty_bit 表示其中有尚未读取的新数据
+    static const int dirty_bit = 4;
+
+    T buffers[3];
+    std::atomic<int> middle{1};
+    int back = 0;
+    int front = 2;
+public:
+    T& write_buffer()
+    {
+        return buffers[back];
+    }
+
+    void publish()
+    {
+        back = middle.exchange(back | dirty_bit, std::memory_order_acq_rel) & 3;
+    }
+
+    // 有新数据时切换到最新发布的缓冲区并返回 true
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & dirty_bit))
+        {
+            return false;
+        }
+        front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+        return true;
+    }
+
+    T& read_buffer()
+    {
+        return buffers[front];
+    }
+};
\ No newline at end of file